@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <iostream>
+#include <mutex>
 #include <vector>
 
 #include "morph.h"
@@ -14,13 +15,13 @@ MutationItem::MutationItem(const MutationData &data)
 { }
 
 
-std::vector<unsigned> getIdentsForSpawn(const std::vector<SpawnLine> &spawnLines, bool processGroup0) {
+std::vector<unsigned> getIdentsForSpawn(const std::vector<SpawnLine> &spawnLines, RNG &rng, bool processGroup0) {
     std::vector<unsigned> toSpawn;
     std::vector<int> spawnGroups;
 
     for (const SpawnLine &line : spawnLines) {
         if (line.spawnGroup == 0) {
-            int roll = globalRNG.upto(100);
+            int roll = rng.upto(100);
             if (roll < line.spawnChance) {
                 toSpawn.push_back(line.ident);
             }
@@ -30,7 +31,7 @@ std::vector<unsigned> getIdentsForSpawn(const std::vector<SpawnLine> &spawnLines
     }
 
     for (int groupId : spawnGroups) {
-        int roll = globalRNG.upto(100);
+        int roll = rng.upto(100);
         for (const SpawnLine &line : spawnLines) {
             if (line.spawnGroup != groupId) continue;
             if (roll < line.spawnChance) {
@@ -44,25 +45,26 @@ std::vector<unsigned> getIdentsForSpawn(const std::vector<SpawnLine> &spawnLines
 }
 
 
-Actor* Actor::create(const ActorData &data) {
+Actor* Actor::create(const ActorData &data, RNG &rng) {
     if (data.ident == BAD_VALUE) return nullptr;
     Actor *actor = new Actor(data, 0);
     if (!actor) return nullptr;
 
-    std::vector<unsigned> toSpawn = getIdentsForSpawn(data.initialItems, true);
+    std::vector<unsigned> toSpawn = getIdentsForSpawn(data.initialItems, rng, true);
     for (unsigned ident : toSpawn) {
-        Item *item = new Item(getItemData(ident));
+        Item *item = new Item(getItemData(ident), rng);
         if (item) {
             actor->addItem(item);
             actor->tryEquipItem(item);
         }
     }
 
-    std::vector<unsigned> mutations = getIdentsForSpawn(data.initialMutations, true);
+    std::vector<unsigned> mutations = getIdentsForSpawn(data.initialMutations, rng, true);
     for (unsigned ident : mutations) {
         MutationItem *mutation = new MutationItem(getMutationData(ident));
         actor->mutations.push_back(mutation);
     }
+    actor->invalidateStats();
 
     return actor;
 }
@@ -70,7 +72,8 @@ Actor* Actor::create(const ActorData &data) {
 Actor::Actor(const ActorData &data, unsigned myIdent)
 : data(data), ident(myIdent), position(-1, -1),
   isPlayer(false), level(0), xp(0), advancementPoints(0), playerLastSeenPosition(-1, -1),
-  speedCounter(0), onMap(nullptr), turnsSinceCombatAction(0)
+  speedCounter(0), scheduleSlot(-1), scheduleOrder(0), onMap(nullptr), turnsSinceCombatAction(0),
+  mStatCacheValid(false)
 {
     level = data.baseLevel;
     for (int i = 0; i < STAT_BASE_COUNT; ++i) {
@@ -82,6 +85,12 @@ Actor::~Actor() {
     for (Item *item : inventory) {
         delete item;
     }
+    for (StatusItem *status : statusEffects) {
+        delete status;
+    }
+    for (MutationItem *mutation : mutations) {
+        delete mutation;
+    }
 }
 
 std::string Actor::getName(bool definitive) const {
@@ -162,9 +171,9 @@ int Actor::getStatBase(int statNumber) const {
         case STAT_TOUGHNESS:    return data.baseStats[statNumber];
         case STAT_EVASION:      return 10 + data.baseStats[statNumber];
 
-        case STAT_HEALTH:       return 20 + getStat(STAT_TOUGHNESS) * 4;
-        case STAT_ENERGY:       return 20 + getStat(STAT_TOUGHNESS) * 2;
-        case STAT_BULK_MAX:     return 10 + getStat(STAT_STRENGTH) * 2;
+        case STAT_HEALTH:       return 20 + calcStat(STAT_TOUGHNESS) * 4;
+        case STAT_ENERGY:       return 20 + calcStat(STAT_TOUGHNESS) * 2;
+        case STAT_BULK_MAX:     return 10 + calcStat(STAT_STRENGTH) * 2;
         case STAT_BULK: {
             int total = 0;
             for (const Item *item : inventory) {
@@ -179,6 +188,21 @@ int Actor::getStatBase(int statNumber) const {
 }
 
 int Actor::getStat(int statNumber) const {
+    if (statNumber < 0 || statNumber >= STAT_ALL_COUNT) return calcStat(statNumber);
+    if (!mStatCacheValid) {
+        for (int i = 0; i < STAT_ALL_COUNT; ++i) {
+            mStatCache[i] = calcStat(i);
+        }
+        mStatCacheValid = true;
+    }
+    return mStatCache[statNumber];
+}
+
+void Actor::invalidateStats() {
+    mStatCacheValid = false;
+}
+
+int Actor::calcStat(int statNumber) const {
     int bonus = 0;
 
     // current bulk can never be boosted
@@ -227,7 +251,9 @@ bool Actor::isOverBurdened() const {
 }
 
 void Actor::addItem(Item *item) {
-    if (item) inventory.push_back(item);
+    if (!item) return;
+    inventory.push_back(item);
+    invalidateStats();
 }
 
 void Actor::removeItem(Item *item) {
@@ -236,6 +262,7 @@ void Actor::removeItem(Item *item) {
     while (iter != inventory.end()) {
         if (*iter == item) {
             inventory.erase(iter);
+            invalidateStats();
             return;
         }
         ++iter;
@@ -253,6 +280,7 @@ void Actor::dropAllItems() {
         onMap->addItem(item, position);
     }
     inventory.clear();
+    invalidateStats();
 }
 
 bool Actor::tryEquipItem(Item *item) {
@@ -275,6 +303,7 @@ bool Actor::tryEquipItem(Item *item) {
         if (!oldWeapon) item->isEquipped = true;
         else return false;
     }
+    invalidateStats();
     return false;
 }
 
@@ -304,7 +333,12 @@ bool Actor::isArmed() const {
     return false;
 }
 
+// shared between all actors, including those on levels being generated in the
+// background, so access is guarded by unarmedWeaponsLock
 static std::vector<Item*> unarmedWeapons;
+static std::mutex unarmedWeaponsLock;
+// only needed to construct the items; weapons don't have charges to roll
+static RNG unarmedWeaponsRNG(1);
 const Item* Actor::getCurrentWeapon() const {
     // first check if the actor is wielding a weapon; if so, just return that one
     for (const Item *item : inventory) {
@@ -326,21 +360,22 @@ const Item* Actor::getCurrentWeapon() const {
     if (weaponIdent == BAD_VALUE) weaponIdent = SIN_FISTS;
 
     // retrieve (or create) and return the item for this weapon
+    std::lock_guard<std::mutex> lock(unarmedWeaponsLock);
     for (Item *item : unarmedWeapons) {
         if (item && item->data.ident == weaponIdent) return item;
     }
-    Item *newWeapon = new Item(getItemData(weaponIdent));
+    Item *newWeapon = new Item(getItemData(weaponIdent), unarmedWeaponsRNG);
     unarmedWeapons.push_back(newWeapon);
     return newWeapon;
 }
 
-std::string Actor::triggerOnHitEffects(Actor *target, const Item *weapon) {
+std::string Actor::triggerOnHitEffects(Actor *target, const Item *weapon, RNG &rng) {
     std::string result;
     if (!weapon) weapon = getCurrentWeapon();
     if (weapon && !weapon->isEquipped) {
         for (const EffectData &data : weapon->data.effects) {
             if (data.trigger == ET_ON_HIT) {
-                result += triggerEffect(data, this, target);
+                result += triggerEffect(data, this, target, rng);
             }
         }
     }
@@ -348,14 +383,14 @@ std::string Actor::triggerOnHitEffects(Actor *target, const Item *weapon) {
         if (!item || !item->isEquipped) continue;
         for (const EffectData &data : item->data.effects) {
             if (data.trigger == ET_ON_HIT) {
-                result += triggerEffect(data, this, target);
+                result += triggerEffect(data, this, target, rng);
             }
         }
     }
     return result;
 }
 
-AttackData Actor::meleeAttackWithWeapon(Actor *target, const Item *weapon) {
+AttackData Actor::meleeAttackWithWeapon(Actor *target, const Item *weapon, RNG &rng) {
     AttackData data;
     if (weapon) data.weapon = weapon;
     else data.weapon = getCurrentWeapon();
@@ -372,7 +407,7 @@ AttackData Actor::meleeAttackWithWeapon(Actor *target, const Item *weapon) {
     target->turnsSinceCombatAction = 0;
     if (target->data.isFragile) {
         target->takeDamage(9999, this);
-        data.effectsMessage = triggerOnHitEffects(target, data.weapon);
+        data.effectsMessage = triggerOnHitEffects(target, data.weapon, rng);
         if (target->isDead() && !target->isPlayer) {
             for (Item *item : target->inventory) data.drops.push_back(item);
             target->dropAllItems();
@@ -386,7 +421,7 @@ AttackData Actor::meleeAttackWithWeapon(Actor *target, const Item *weapon) {
         data.damage = 9999;
 
     } else {
-        data.roll = 1 + globalRNG.upto(20);
+        data.roll = 1 + rng.upto(20);
         data.toHit = getStat(STAT_ACCURACY);
         data.evasion = target->getStat(STAT_EVASION);
         int damageBonus = getStat(STAT_DAMAGE_BONUS);
@@ -408,11 +443,11 @@ AttackData Actor::meleeAttackWithWeapon(Actor *target, const Item *weapon) {
             data.damageMin = data.weapon->data.minDamage;
             data.damageMax = data.weapon->data.maxDamage;
             data.damageBonus = getStat(STAT_STRENGTH) + damageBonus;
-            data.damage = data.weapon->data.minDamage + globalRNG.upto(damageRange) + getStat(STAT_STRENGTH);
+            data.damage = data.weapon->data.minDamage + rng.upto(damageRange) + getStat(STAT_STRENGTH);
             data.damage += damageBonus;
             if (data.damage < 1) data.damage = 1;
             target->takeDamage(data.damage, this);
-            data.effectsMessage = triggerOnHitEffects(target, data.weapon);
+            data.effectsMessage = triggerOnHitEffects(target, data.weapon, rng);
             if (target->isDead() && !target->isPlayer) {
                 for (Item *item : target->inventory) data.drops.push_back(item);
                 target->dropAllItems();
@@ -422,14 +457,15 @@ AttackData Actor::meleeAttackWithWeapon(Actor *target, const Item *weapon) {
     return data;
 }
 
-AttackData Actor::meleeAttack(Actor *target) {
-    return meleeAttackWithWeapon(target, nullptr);
+AttackData Actor::meleeAttack(Actor *target, RNG &rng) {
+    return meleeAttackWithWeapon(target, nullptr, rng);
 }
 
 void Actor::advanceSpeedCounter(int multiplier) {
     int turnTime = getStat(STAT_SPEED) * -2 + 10;
     turnTime = turnTime * multiplier / 100;
     speedCounter += turnTime;
+    if (onMap) onMap->updateSchedule(this);
 }
 
 MutationItem* Actor::mutationForSlot(unsigned slotNumber) {
@@ -467,6 +503,7 @@ void Actor::applyMutation(MutationItem *mutation) {
     if (!mutation->data.isNonMutation()) {
         mutations.push_back(mutation);
         std::sort(mutations.begin(), mutations.end(), mutationSort);
+        invalidateStats();
     }
 }
 
@@ -475,6 +512,7 @@ void Actor::removeMutation(MutationItem *mutation) {
     while (iter != mutations.end()) {
         if (*iter == mutation) {
             mutations.erase(iter);
+            invalidateStats();
             return;
         }
         ++iter;
@@ -483,6 +521,7 @@ void Actor::removeMutation(MutationItem *mutation) {
 
 void Actor::applyStatus(StatusItem *statusItem) {
     statusEffects.push_back(statusItem);
+    invalidateStats();
 }
 
 bool Actor::hasStatus(unsigned statusIdent) const {
@@ -0,0 +1,274 @@
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "physfs.h"
+#include "morph.h"
+
+
+/* ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****
+ * BENCHMARK DRIVER
+ * Times the hot paths of the game core over a list of seeds and reports the
+ * average time and number of heap allocations per operation. Each seed always
+ * produces the same levels, so runs are comparable between builds.
+ * ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****/
+
+bool headlessStartup(const char *argv0);
+
+// Number of heap allocations made so far; see bench_alloc.cpp.
+uint64_t heapAllocationCount();
+
+
+struct BenchResult {
+    std::string name;
+    uint64_t operations;
+    uint64_t nanoseconds;
+    uint64_t allocations;
+};
+
+class BenchRunner {
+public:
+    // Time a block of work that performs `operations` operations and add it
+    // to the running totals for the named benchmark.
+    template<class Work>
+    void run(const std::string &name, uint64_t operations, Work work) {
+        uint64_t startAllocations = heapAllocationCount();
+        auto startTime = std::chrono::steady_clock::now();
+        work();
+        auto endTime = std::chrono::steady_clock::now();
+        uint64_t allocations = heapAllocationCount() - startAllocations;
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count();
+
+        BenchResult &result = getResult(name);
+        result.operations += operations;
+        result.nanoseconds += ns;
+        result.allocations += allocations;
+    }
+
+    void report() const {
+        std::cout << std::left << std::setw(28) << "benchmark";
+        std::cout << std::right << std::setw(10) << "ops";
+        std::cout << std::setw(14) << "ns/op";
+        std::cout << std::setw(14) << "allocs/op" << '\n';
+        for (const BenchResult &result : results) {
+            double ops = result.operations ? result.operations : 1;
+            std::cout << std::left << std::setw(28) << result.name;
+            std::cout << std::right << std::setw(10) << result.operations;
+            std::cout << std::fixed << std::setprecision(1);
+            std::cout << std::setw(14) << result.nanoseconds / ops;
+            std::cout << std::setw(14) << result.allocations / ops << '\n';
+        }
+    }
+
+private:
+    BenchResult& getResult(const std::string &name) {
+        for (BenchResult &result : results) {
+            if (result.name == name) return result;
+        }
+        results.push_back(BenchResult{name, 0, 0, 0});
+        return results.back();
+    }
+
+    std::vector<BenchResult> results;
+};
+
+
+static std::vector<Coord> passablePositions(const Dungeon &d) {
+    std::vector<Coord> positions;
+    for (int y = 0; y < d.height(); ++y) {
+        for (int x = 0; x < d.width(); ++x) {
+            Coord here(x, y);
+            if (d.isPassable(here)) positions.push_back(here);
+        }
+    }
+    return positions;
+}
+
+static void benchMapgen(BenchRunner &runner, uint64_t seed, int firstDepth) {
+    for (int depth = firstDepth; ; ++depth) {
+        const DungeonData &data = getDungeonData(depth);
+        if (data.ident == BAD_VALUE) break;
+        if (data.fromFile) continue;
+        Dungeon d(data, data.mapgen.width, data.mapgen.height);
+        RNG rng(seed + data.ident);
+        runner.run("doMapgen", 1, [&]() {
+            doMapgen(d, rng);
+        });
+    }
+}
+
+static void benchRNG(BenchRunner &runner, uint64_t seed) {
+    const unsigned count = 100000;
+    std::vector<int> values(count);
+    RNG rng(seed);
+    runner.run("RNG::upto", count, [&]() {
+        for (unsigned i = 0; i < count; ++i) values[i] = rng.upto(61);
+    });
+    runner.run("RNG::fill", count, [&]() {
+        rng.fill(values.data(), count, 61);
+    });
+}
+
+static void benchLevel(BenchRunner &runner, Dungeon &d, Actor *viewer) {
+    const std::vector<Coord> positions = passablePositions(d);
+    if (positions.empty()) return;
+    const uint64_t count = positions.size();
+
+    // time the reference engine alongside the bit-parallel one
+    const int fovEngines[] = { FOV_BIT_PARALLEL, FOV_DIAMOND_WALLS };
+    const char *fovEngineNames[] = { "handlePlayerFOV", "handlePlayerFOV diamond" };
+    for (int i = 0; i < 2; ++i) {
+        setFovEngine(fovEngines[i]);
+        runner.run(fovEngineNames[i], count, [&]() {
+            for (const Coord &pos : positions) {
+                viewer->position = pos;
+                handlePlayerFOV(&d, viewer);
+            }
+        });
+        d.clearIsSeen();
+    }
+    setFovEngine(FOV_BIT_PARALLEL);
+
+    runner.run("calcDistances", count, [&]() {
+        for (const Coord &pos : positions) d.calcDistances(pos);
+    });
+
+    // the first pass fills the line of sight cache and the second reuses it
+    std::vector<Actor*> seers;
+    const char *sightNames[] = { "actorsThatSee", "actorsThatSee cached" };
+    for (const char *name : sightNames) {
+        runner.run(name, count, [&]() {
+            for (const Coord &pos : positions) d.actorsThatSee(pos, seers);
+        });
+    }
+
+    // nothing uses AR_TARGET yet and getEffectArea doesn't handle it, so
+    // it would only be timing the error log
+    const int areaTypes[] = { AR_NONE, AR_CONE, AR_LINE, AR_BURST, AR_PASSIVE };
+    const char *areaNames[] = { "AR_NONE", "AR_CONE", "AR_LINE", "AR_BURST", "AR_PASSIVE" };
+    // the range of fire breath, so the areas use the same FOV tables as the
+    // game's own abilities
+    const int areaRange = 8;
+    EffectArea area;
+    for (int i = 0; i < 5; ++i) {
+        runner.run(std::string("getEffectArea ") + areaNames[i], count, [&]() {
+            for (unsigned j = 0; j < positions.size(); ++j) {
+                const Coord &target = positions[(j * 7 + 13) % positions.size()];
+                d.getEffectArea(positions[j], target, areaTypes[i], areaRange, false, false, area);
+            }
+        });
+    }
+}
+
+static void benchTicks(BenchRunner &runner, uint64_t seed, unsigned rounds) {
+    World *world = createGame(seed, 0);
+    if (!world) return;
+    // the entrance level is predesigned and has no monsters, so go down one
+    // to a populated level
+    world->movePlayerToDepth(world->map->depth() + 1, DE_DOWNSTAIRS);
+    Actor *player = world->player;
+    runner.run("Dungeon::tick", rounds, [&]() {
+        for (unsigned i = 0; i < rounds; ++i) {
+            // keep the player standing so every round does a full tick
+            player->health = player->getStat(STAT_HEALTH);
+            player->advanceSpeedCounter();
+            world->map->tick(*world);
+        }
+    });
+    delete world;
+}
+
+// saves a game with every level generated, the largest a save can get
+static void benchSaveLoad(BenchRunner &runner, uint64_t seed, int firstDepth) {
+    World *world = createGame(seed, 0);
+    if (!world) return;
+    for (int depth = firstDepth; getDungeonData(depth).ident != BAD_VALUE; ++depth) {
+        world->getDungeon(depth);
+    }
+    const std::string filename = "bench.sav";
+    runner.run("saveGame", 1, [&]() {
+        saveGame(*world, filename);
+    });
+    delete world;
+    runner.run("loadGame", 1, [&]() {
+        world = loadGame(filename);
+    });
+    delete world;
+    PHYSFS_delete(filename.c_str());
+}
+
+static void showUsage(const char *programName) {
+    std::cerr << "USAGE: " << programName << " [options] [seed ...]\n";
+    std::cerr << "    -count N          use seeds 1 through N (if no seeds are listed; default 5)\n";
+    std::cerr << "    -rounds N         number of Dungeon::tick rounds per seed (default 2000)\n";
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<uint64_t> seeds;
+    unsigned seedCount = 5;
+    unsigned tickRounds = 2000;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "-count" && hasValue) {
+            if (!strToInt(argv[++i], seedCount) || seedCount == 0) {
+                std::cerr << "Seed count must be a positive integer.\n";
+                return 1;
+            }
+        } else if (arg == "-rounds" && hasValue) {
+            if (!strToInt(argv[++i], tickRounds)) {
+                std::cerr << "Tick rounds must be an integer.\n";
+                return 1;
+            }
+        } else if (arg[0] != '-') {
+            unsigned seed = 0;
+            if (!strToInt(arg, seed) || seed == 0) {
+                std::cerr << "Game seeds must be non-zero integer values.\n";
+                return 1;
+            }
+            seeds.push_back(seed);
+        } else {
+            showUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (seeds.empty()) {
+        for (unsigned i = 1; i <= seedCount; ++i) seeds.push_back(i);
+    }
+
+    if (!headlessStartup(argv[0])) return 1;
+    const int firstDepth = getDungeonEntranceIdent();
+
+    BenchRunner runner;
+    RNG viewerRNG(1);
+    Actor *viewer = Actor::create(getActorData(0), viewerRNG);
+    for (uint64_t seed : seeds) {
+        std::cerr << "seed " << seed << "...\n";
+        benchRNG(runner, seed);
+        benchMapgen(runner, seed, firstDepth);
+
+        World world;
+        world.gameSeed = seed;
+        std::vector<Dungeon*> levels;
+        for (int depth = firstDepth; ; ++depth) {
+            if (getDungeonData(depth).ident == BAD_VALUE) break;
+            Dungeon *d = nullptr;
+            runner.run("World::getDungeon", 1, [&]() {
+                d = world.getDungeon(depth);
+            });
+            if (d) levels.push_back(d);
+        }
+        for (Dungeon *d : levels) benchLevel(runner, *d, viewer);
+
+        if (tickRounds > 0) benchTicks(runner, seed, tickRounds);
+        benchSaveLoad(runner, seed, firstDepth);
+    }
+    delete viewer;
+
+    runner.report();
+    PHYSFS_deinit();
+    return 0;
+}
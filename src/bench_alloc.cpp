@@ -0,0 +1,61 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+
+/* ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****
+ * BENCHMARK ALLOCATION COUNTER
+ * Replaces the global allocation functions so the benchmark can report how
+ * many trips to the heap each operation makes. Every replaceable form is
+ * defined so each pointer is released by the counterpart of the function
+ * that allocated it. These live apart from the benchmark itself so the
+ * compiler can't inline them into its callers and pair malloc with delete.
+ * ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****/
+
+static std::atomic<uint64_t> allocationCount(0);
+
+uint64_t heapAllocationCount() {
+    return allocationCount;
+}
+
+static void* countedAllocate(std::size_t size) noexcept {
+    ++allocationCount;
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new(std::size_t size) {
+    void *ptr = countedAllocate(size);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+void* operator new[](std::size_t size) {
+    void *ptr = countedAllocate(size);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size);
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+void operator delete[](void *ptr) noexcept {
+    std::free(ptr);
+}
+void operator delete(void *ptr, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
+void operator delete[](void *ptr, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+void operator delete[](void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
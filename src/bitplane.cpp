@@ -0,0 +1,98 @@
+#include "morph.h"
+
+
+BitPlane::iterator::iterator(const uint64_t *words, unsigned wordCount, unsigned wordIndex)
+: mWords(words), mWordCount(wordCount), mWordIndex(wordIndex), mWord(0)
+{
+    if (mWordIndex < mWordCount) {
+        mWord = mWords[mWordIndex];
+        skipEmptyWords();
+    }
+}
+
+BitPlane::iterator& BitPlane::iterator::operator++() {
+    // drop the lowest set bit, moving on to the next word once this one is
+    // exhausted
+    mWord &= mWord - 1;
+    skipEmptyWords();
+    return *this;
+}
+
+void BitPlane::iterator::skipEmptyWords() {
+    while (mWord == 0 && mWordIndex < mWordCount) {
+        ++mWordIndex;
+        if (mWordIndex < mWordCount) mWord = mWords[mWordIndex];
+    }
+}
+
+
+BitPlane::BitPlane(unsigned size)
+: mSize(0)
+{
+    resize(size);
+}
+
+void BitPlane::resize(unsigned size) {
+    mSize = size;
+    mWords.assign((size + 63) / 64, 0);
+}
+
+void BitPlane::clear() {
+    for (uint64_t &word : mWords) word = 0;
+}
+
+void BitPlane::clear(unsigned first, unsigned last) {
+    if (first >= last) return;
+    unsigned firstWord = first >> 6, lastWord = (last - 1) >> 6;
+    // masks of the bits to keep at either end
+    uint64_t keepLow = (uint64_t(1) << (first & 63)) - 1;
+    uint64_t keepHigh = (last & 63) ? ~((uint64_t(1) << (last & 63)) - 1) : 0;
+    if (firstWord == lastWord) {
+        mWords[firstWord] &= keepLow | keepHigh;
+        return;
+    }
+    mWords[firstWord] &= keepLow;
+    for (unsigned i = firstWord + 1; i < lastWord; ++i) mWords[i] = 0;
+    mWords[lastWord] &= keepHigh;
+}
+
+void BitPlane::fill(unsigned first, unsigned last) {
+    if (first >= last) return;
+    unsigned firstWord = first >> 6, lastWord = (last - 1) >> 6;
+    uint64_t firstMask = ~uint64_t(0) << (first & 63);
+    uint64_t lastMask = ~uint64_t(0) >> (63 - ((last - 1) & 63));
+    if (firstWord == lastWord) {
+        mWords[firstWord] |= firstMask & lastMask;
+        return;
+    }
+    mWords[firstWord] |= firstMask;
+    for (unsigned i = firstWord + 1; i < lastWord; ++i) mWords[i] = ~uint64_t(0);
+    mWords[lastWord] |= lastMask;
+}
+
+BitPlane::Span BitPlane::span(unsigned first, unsigned last) const {
+    if (first >= last) return Span(end(), end());
+    unsigned wordCount = ((last - 1) >> 6) + 1;
+    return Span(iterator(mWords.data(), wordCount, first >> 6),
+                iterator(mWords.data(), wordCount, wordCount));
+}
+
+void BitPlane::merge(const BitPlane &other) {
+    unsigned words = mWords.size() < other.mWords.size() ? mWords.size() : other.mWords.size();
+    for (unsigned i = 0; i < words; ++i) {
+        mWords[i] |= other.mWords[i];
+    }
+}
+
+unsigned BitPlane::count() const {
+    unsigned total = 0;
+    for (uint64_t word : mWords) total += __builtin_popcountll(word);
+    return total;
+}
+
+bool BitPlane::any() const {
+    for (uint64_t word : mWords) {
+        if (word) return true;
+    }
+    return false;
+}
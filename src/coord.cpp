@@ -3,14 +3,14 @@
 
 #include "morph.h"
 
-Direction randomDirection() {
-    int i = globalRNG.upto(8);
+Direction randomDirection(RNG &rng) {
+    int i = rng.upto(8);
     return static_cast<Direction>(i + 2);
 }
 
 
-Direction randomCardinalDirection() {
-    switch(globalRNG.upto(4)) {
+Direction randomCardinalDirection(RNG &rng) {
+    switch(rng.upto(4)) {
         case 0: return Direction::North;
         case 1: return Direction::East;
         case 2: return Direction::South;
@@ -75,6 +75,69 @@ DungeonData BAD_DUNGEON{BAD_VALUE, "invalid"};
 std::vector<DungeonData> dungeonData;
 
 
+/* ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****
+ * IDENT INDEXES
+ * Every data lookup goes through one of these once loading has finished. Most
+ * idents are small and close together, so each is found by indexing a table
+ * directly; any idents too large to fit in the table fall back to a binary
+ * search of the sorted data. Until an index is built (i.e. while the data is
+ * still being loaded) lookups scan the data instead.
+ * ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****/
+const unsigned MAX_DENSE_IDENT = 4096;
+
+template<class T>
+class DataIndex {
+public:
+    DataIndex(const std::vector<T> &data, const T &badValue)
+    : mData(data), mBadValue(badValue), mBuilt(false)
+    { }
+
+    // the data must be sorted by ident before this is called
+    void build() {
+        unsigned denseSize = 0;
+        for (const T &entry : mData) {
+            if (entry.ident < MAX_DENSE_IDENT && entry.ident >= denseSize) denseSize = entry.ident + 1;
+        }
+        mDense.assign(denseSize, BAD_VALUE);
+        for (unsigned i = 0; i < mData.size(); ++i) {
+            if (mData[i].ident < denseSize) mDense[mData[i].ident] = i;
+        }
+        mBuilt = true;
+    }
+
+    const T& get(unsigned ident) const {
+        if (!mBuilt) {
+            for (const T &entry : mData) {
+                if (entry.ident == ident) return entry;
+            }
+            return mBadValue;
+        }
+        if (ident < mDense.size()) {
+            unsigned pos = mDense[ident];
+            return pos == BAD_VALUE ? mBadValue : mData[pos];
+        }
+        auto iter = std::lower_bound(mData.begin(), mData.end(), ident,
+                        [](const T &entry, unsigned ident) { return entry.ident < ident; });
+        if (iter == mData.end() || iter->ident != ident) return mBadValue;
+        return *iter;
+    }
+
+private:
+    const std::vector<T> &mData;
+    const T &mBadValue;
+    bool mBuilt;
+    std::vector<unsigned> mDense;
+};
+
+DataIndex<ActorData> actorIndex(actorData, BAD_ACTOR);
+DataIndex<ItemData> itemIndex(itemData, BAD_ITEM);
+DataIndex<StatusData> statusIndex(statusData, BAD_STATUS);
+DataIndex<MutationData> mutationIndex(mutationData, BAD_MUTATION);
+DataIndex<AbilityData> abilityIndex(abilityData, BAD_ABILITY);
+DataIndex<TileData> tileIndex(tileData, BAD_TILE);
+DataIndex<DungeonData> dungeonIndex(dungeonData, BAD_DUNGEON);
+
+
 bool MutationData::isNonMutation() const {
     for (const EffectData &ed : effects) {
         if (ed.trigger == ET_NO_MUTATION) return true;
@@ -122,37 +185,25 @@ const DefineValue* RawData::getDefine(const std::string &name) {
 
 
 const ActorData& getActorData(unsigned ident) {
-    for (const ActorData &data : actorData) {
-        if (data.ident == ident) return data;
-    }
-    return BAD_ACTOR;
+    return actorIndex.get(ident);
 }
 
 const ItemData& getItemData(unsigned ident) {
-    for (const ItemData &data : itemData) {
-        if (data.ident == ident) return data;
-    }
-    return BAD_ITEM;
+    return itemIndex.get(ident);
 }
 
 const MutationData& getMutationData(unsigned ident) {
-    for (const MutationData &data : mutationData) {
-        if (data.ident == ident) return data;
-    }
-    return BAD_MUTATION;
+    return mutationIndex.get(ident);
 }
 
 const AbilityData& getAbilityData(unsigned ident) {
-    for (const AbilityData &data : abilityData) {
-        if (data.ident == ident) return data;
-    }
-    return BAD_ABILITY;
+    return abilityIndex.get(ident);
 }
 
-const MutationData& getRandomMutationData(Actor *forWho) {
+const MutationData& getRandomMutationData(Actor *forWho, RNG &rng) {
     if (mutationData.empty()) return BAD_MUTATION;
     while (1) {
-        unsigned i = globalRNG.upto(mutationData.size());
+        unsigned i = rng.upto(mutationData.size());
         const MutationData &data = mutationData[i];
         if (forWho) {
             if (forWho->hasMutation(data.ident)) continue;
@@ -163,24 +214,34 @@ const MutationData& getRandomMutationData(Actor *forWho) {
 }
 
 const StatusData& getStatusData(unsigned ident) {
-    for (const StatusData &data : statusData) {
-        if (data.ident == ident) return data;
-    }
-    return BAD_STATUS;
+    return statusIndex.get(ident);
 }
 
 const TileData& getTileData(unsigned ident) {
+    return tileIndex.get(ident);
+}
+
+// The properties of tiles needed by FOV and pathing, indexed directly by tile
+// ident so those don't need to look up the full tile definitions.
+static uint8_t tileFlags[MAX_TILE_IDENT + 1];
+
+static void buildTileFlags() {
+    for (uint8_t &flags : tileFlags) flags = 0;
     for (const TileData &data : tileData) {
-        if (data.ident == ident) return data;
+        uint8_t flags = 0;
+        if (data.isPassable)    flags |= TF_PASSABLE;
+        if (data.isOpaque)      flags |= TF_OPAQUE;
+        tileFlags[data.ident] = flags;
     }
-    return BAD_TILE;
+}
+
+unsigned getTileFlags(unsigned ident) {
+    if (ident > static_cast<unsigned>(MAX_TILE_IDENT)) return 0;
+    return tileFlags[ident];
 }
 
 const DungeonData& getDungeonData(unsigned ident) {
-    for (const DungeonData &data : dungeonData) {
-        if (data.ident == ident) return data;
-    }
-    return BAD_DUNGEON;
+    return dungeonIndex.get(ident);
 }
 unsigned getDungeonEntranceIdent() {
     for (const DungeonData &data : dungeonData) {
@@ -804,6 +865,11 @@ bool processTileData(RawData &rawData, const DataTemp *rawTile) {
         }
     }
 
+    // map floors are stored one byte per tile
+    if (resultData.ident > MAX_TILE_IDENT) {
+        rawData.addError(rawTile->origin, "tile ident " + std::to_string(resultData.ident) + " exceeds maximum of " + std::to_string(MAX_TILE_IDENT));
+        return false;
+    }
     const TileData &oldTileData = getTileData(resultData.ident);
     if (oldTileData.ident == resultData.ident) {
         rawData.addError(rawTile->origin, "tile ident " + std::to_string(resultData.ident) + " already used");
@@ -824,7 +890,52 @@ std::vector<DataDef> dungeonPropData{
     { "actor",          3 },
     { "itemCount",      1 },
     { "item",           3 },
+    { "size",           2 },
+    { "roomAttempts",   1 },
+    { "roomFillChance", 1 },
+    { "roomSecondDoorChance", 1 },
+    { "roomMaxSize",    2 },
+    { "mazeDoorChance", 1 },
+    { "deadEndTrimPasses", 1 },
+    { "deadEndFillChance", 1 },
+    { "deadEndDoorChance", 1 },
+    { "extraDoors",     1 },
+};
+// the mapgen settings for levels that don't give their own
+const MapgenArgs DEFAULT_MAPGEN_ARGS{
+    MAP_WIDTH,  // width
+    MAP_HEIGHT, // height
+    10000,      // roomAttempts
+    10,         // roomFillChance
+    40,         // roomSecondDoorChance
+    10,         // roomMaxWidth
+    10,         // roomMaxHeight
+    20,         // mazeDoorChance
+    0,          // deadEndTrimPasses
+    70,         // deadEndFillChance
+    15,         // deadEndDoorChance
+    5,          // extraDoorCount
 };
+static bool checkMapgenArgs(RawData &rawData, const DataTemp *rawDungeon, const MapgenArgs &args) {
+    const std::string where = "dungeon " + std::to_string(rawDungeon->ident);
+    bool isGood = true;
+    if (args.width < MIN_MAP_SIZE || args.height < MIN_MAP_SIZE
+            || args.width > MAX_MAP_SIZE || args.height > MAX_MAP_SIZE) {
+        rawData.addError(rawDungeon->origin, where + " size must be between " + std::to_string(MIN_MAP_SIZE)
+                                             + " and " + std::to_string(MAX_MAP_SIZE));
+        isGood = false;
+    }
+    if (args.roomMaxWidth < 3 || args.roomMaxHeight < 3
+            || args.roomMaxWidth > args.width - 2 || args.roomMaxHeight > args.height - 2) {
+        rawData.addError(rawDungeon->origin, where + " roomMaxSize must be at least 3 and fit within the level");
+        isGood = false;
+    }
+    if (args.roomAttempts < 0 || args.deadEndTrimPasses < 0 || args.extraDoorCount < 0) {
+        rawData.addError(rawDungeon->origin, where + " has a negative mapgen count");
+        isGood = false;
+    }
+    return isGood;
+}
 bool processDungeonData(RawData &rawData, const DataTemp *rawDungeon) {
     if (!rawDungeon || rawDungeon->typeName != "@dungeon") {
         rawData.addError(Origin(), "processDungeonData passed malformed data");
@@ -841,6 +952,7 @@ bool processDungeonData(RawData &rawData, const DataTemp *rawDungeon) {
     resultData.initialPosition.y = -1;
     resultData.actorCount = 0;
     resultData.itemCount = 0;
+    resultData.mapgen = DEFAULT_MAPGEN_ARGS;
     for (const DataProp &prop : rawDungeon->props) {
         const DataDef &dataDef = getDataDef(dungeonPropData, prop.name);
         if (dataDef.partCount == BAD_VALUE) {
@@ -877,11 +989,34 @@ bool processDungeonData(RawData &rawData, const DataTemp *rawDungeon) {
                 spawnLine.spawnChance = dataAsInt(rawData, prop.origin, prop.value[1]);
                 spawnLine.ident       = dataAsInt(rawData, prop.origin, prop.value[2]);
                 resultData.itemSpawns.push_back(spawnLine);
+            } else if (prop.name == "size") {
+                resultData.mapgen.width = dataAsInt(rawData, prop.origin, prop.value[0]);
+                resultData.mapgen.height = dataAsInt(rawData, prop.origin, prop.value[1]);
+            } else if (prop.name == "roomAttempts") {
+                resultData.mapgen.roomAttempts = dataAsInt(rawData, prop.origin, prop.value[0]);
+            } else if (prop.name == "roomFillChance") {
+                resultData.mapgen.roomFillChance = dataAsInt(rawData, prop.origin, prop.value[0]);
+            } else if (prop.name == "roomSecondDoorChance") {
+                resultData.mapgen.roomSecondDoorChance = dataAsInt(rawData, prop.origin, prop.value[0]);
+            } else if (prop.name == "roomMaxSize") {
+                resultData.mapgen.roomMaxWidth = dataAsInt(rawData, prop.origin, prop.value[0]);
+                resultData.mapgen.roomMaxHeight = dataAsInt(rawData, prop.origin, prop.value[1]);
+            } else if (prop.name == "mazeDoorChance") {
+                resultData.mapgen.mazeDoorChance = dataAsInt(rawData, prop.origin, prop.value[0]);
+            } else if (prop.name == "deadEndTrimPasses") {
+                resultData.mapgen.deadEndTrimPasses = dataAsInt(rawData, prop.origin, prop.value[0]);
+            } else if (prop.name == "deadEndFillChance") {
+                resultData.mapgen.deadEndFillChance = dataAsInt(rawData, prop.origin, prop.value[0]);
+            } else if (prop.name == "deadEndDoorChance") {
+                resultData.mapgen.deadEndDoorChance = dataAsInt(rawData, prop.origin, prop.value[0]);
+            } else if (prop.name == "extraDoors") {
+                resultData.mapgen.extraDoorCount = dataAsInt(rawData, prop.origin, prop.value[0]);
             } else {
                 rawData.addError(prop.origin, "unhandled property name " + prop.name);
             }
         }
     }
+    if (!checkMapgenArgs(rawData, rawDungeon, resultData.mapgen)) return false;
 
     const DungeonData &oldDungeonData = getDungeonData(resultData.ident);
     if (oldDungeonData.ident == resultData.ident) {
@@ -946,7 +1081,19 @@ bool loadAllData() {
     sortDataEntries(actorData);
     sortDataEntries(statusData);
     sortDataEntries(mutationData);
+    sortDataEntries(abilityData);
     sortDataEntries(dungeonData);
+    actorIndex.build();
+    itemIndex.build();
+    statusIndex.build();
+    mutationIndex.build();
+    abilityIndex.build();
+    tileIndex.build();
+    dungeonIndex.build();
+    buildTileFlags();
+    std::vector<int> abilityRanges;
+    for (const AbilityData &ability : abilityData) abilityRanges.push_back(ability.maxRange);
+    buildFovTables(abilityRanges);
 
     logMessage(LOG_INFO, "LOADED " + std::to_string(tileData.size())     + " tiles (next ident: "          + std::to_string(maxTile+1)     + ")");
     logMessage(LOG_INFO, "LOADED " + std::to_string(itemData.size())     + " items (next ident: "          + std::to_string(maxItem+1)     + ")");
@@ -0,0 +1,18 @@
+#include "morph.h"
+
+
+void DistanceMap::resize(int width, int height) {
+    mWidth = width;
+    mHeight = height;
+    mDistance.assign(width * height, -1);
+    mQueue.resize(width * height);
+}
+
+void DistanceMap::clear() {
+    std::fill(mDistance.begin(), mDistance.end(), -1);
+}
+
+int DistanceMap::at(const Coord &where) const {
+    if (!isValid(where.x, where.y)) return -1;
+    return mDistance[where.x + where.y * mWidth];
+}
@@ -1,5 +1,5 @@
+#include <algorithm>
 #include <map>
-#include <deque>
 #include <iostream>
 #include <sstream>
 #include <vector>
@@ -7,9 +7,7 @@
 #include "morph.h"
 
 
-MapTile::MapTile()
-: floor(0), actor(nullptr), temperature(0), isSeen(false), everSeen(false), inFovCalc(false)
-{ }
+const std::vector<Item*> NO_ITEMS;
 
 
 int Room::area() const {
@@ -17,9 +15,9 @@ int Room::area() const {
 }
 
 
-Coord Room::getPointWithin() const {
-    int dx = globalRNG.upto(w / 2);
-    int dy = globalRNG.upto(h / 2);
+Coord Room::getPointWithin(RNG &rng) const {
+    int dx = rng.upto(w / 2);
+    int dy = rng.upto(h / 2);
     dx *= 2;
     dy *= 2;
     return Coord(1 + x + dx, 1 + y + dy);
@@ -28,34 +26,56 @@ Coord Room::getPointWithin() const {
 
 
 Dungeon::Dungeon(const DungeonData &data, int width, int height)
-: data(data), mDepth(data.ident), mWidth(width), mHeight(height)
+: data(data), mapgenStats(), mDepth(data.ident), mWidth(width), mHeight(height),
+  mSeenFrom(-1, -1), mSeenVersion(0),
+  mPlayerDistancesFrom(-1, -1), mPlayerDistancesVersion(0), mTerrainVersion(1), mSightVersion(0)
 {
-    mData = new MapTile[mWidth * mHeight];
+    unsigned size = mWidth * mHeight;
+    mFloor.resize(size, TILE_UNASSIGNED);
+    mTileSlot.resize(size);
+    mPassableSlot.resize(size);
+    mOpaque.resize(size);
+    mPassable.resize(size);
+    mOpaqueColumns.resize(size);
+    mSeen.resize(size);
+    mEverSeen.resize(size);
+    mFovCalc.resize(size);
+    mFovCalcFirst = size;
+    mFovCalcLast = 0;
+    mDistances.resize(mWidth, mHeight);
+    mPlayerDistances.resize(mWidth, mHeight);
+    mTemperature.resize(size, 0);
+    mOccupant.resize(size, nullptr);
+    refreshTileFlags();
+}
+
+Dungeon::~Dungeon() {
+    // the player belongs to the World rather than to whichever level they're
+    // currently standing on
+    for (Actor *actor : mActors) {
+        if (!actor->isPlayer) delete actor;
+    }
+    for (auto &itemList : mItems) {
+        for (Item *item : itemList.second) delete item;
+    }
 }
 
 
 void Dungeon::clear() {
-    if (!mData) return;
-    unsigned size = mWidth * mHeight;
-    for (unsigned i = 0; i < size; ++i) {
-        mData[i].floor = 0;
-    }
+    std::fill(mFloor.begin(), mFloor.end(), 0);
+    refreshTileFlags();
 }
 
 void Dungeon::clearDistances() {
-    if (!mData) return;
-    unsigned size = mWidth * mHeight;
-    for (unsigned i = 0; i < size; ++i) {
-        mData[i].distanceValue = -1;
-    }
+    mDistances.clear();
 }
 
 
 bool Dungeon::areaIsTile(int x, int y, int w, int h, int theTile) const {
     for (int wy = y; wy < y + h; wy++) {
         for (int wx = x; wx < x + w; wx++) {
-            const MapTile *tile = at(Coord(wx, wy));
-            if (!tile || tile->floor != theTile) return false;
+            Coord here(wx, wy);
+            if (!isValidPosition(here) || mFloor[toPosition(here)] != theTile) return false;
         }
     }
     return true;
@@ -66,16 +86,12 @@ void Dungeon::drawRect(int x, int y, int w, int h, int toTile) {
     int x2 = x + w - 1;
     int y2 = y + h - 1;
     for (int wx = x; wx <= x2; ++wx) {
-        MapTile *tile = at(Coord(wx, y));
-        if (tile) tile->floor = toTile;
-        tile = at(Coord(wx, y2));
-        if (tile) tile->floor = toTile;
+        floorAt(Coord(wx, y), toTile);
+        floorAt(Coord(wx, y2), toTile);
     }
     for (int wy = y; wy <= y2; ++wy) {
-        MapTile *tile = at(Coord(x, wy));
-        if (tile) tile->floor = toTile;
-        tile = at(Coord(x2, wy));
-        if (tile) tile->floor = toTile;
+        floorAt(Coord(x, wy), toTile);
+        floorAt(Coord(x2, wy), toTile);
     }
 }
 
@@ -83,69 +99,78 @@ void Dungeon::drawRect(int x, int y, int w, int h, int toTile) {
 void Dungeon::fillRect(int x, int y, int w, int h, int toTile) {
     for (int wy = y; wy < y + h; wy++) {
         for (int wx = x; wx < x + w; wx++) {
-            MapTile *tile = at(Coord(wx, wy));
-            if (tile) tile->floor = toTile;
+            floorAt(Coord(wx, wy), toTile);
         }
     }
 }
 
 
 void Dungeon::replaceTile(int fromTile, int toTile) {
-    if (!mData) return;
-    unsigned size = mWidth * mHeight;
+    unsigned size = mFloor.size();
     for (unsigned i = 0; i < size; ++i) {
-        if (mData[i].floor == fromTile) {
-            mData[i].floor = toTile;
-        }
+        if (mFloor[i] == fromTile) setFloor(i, toTile);
     }
 }
 
+// used to check that every part of a level can be reached, so closed doors
+// count as open
 void Dungeon::calcDistances(const Coord &fromWhere) {
-    clearDistances();
-    std::deque<Coord> worklist;
-    worklist.push_front(fromWhere);
-    MapTile *originTile = at(fromWhere);
-    if (!originTile) return;
-    originTile->distanceValue = 0;
-
-    while (!worklist.empty()) {
-        const Coord work = worklist.front();
-        worklist.pop_front();
-        MapTile *tileA = at(work);
-        if (!tileA) continue;
-        Direction dir = Direction::North;
-        do {
-            Coord adj = work.shift(dir);
-            dir = rotate45(dir);
-            MapTile *tileB = at(adj);
-            if (!tileB) continue;
-            if (tileB->distanceValue >= 0) continue;
-            const TileData &td = getTileData(tileB->floor);
-            if (!td.isPassable && td.ident != TILE_CLOSED_DOOR) continue;
-            tileB->distanceValue = tileA->distanceValue + 1;
-            worklist.push_back(adj);
-        } while (dir != Direction::North);
+    mDistances.calculate(std::vector<Coord>{ fromWhere }, [this](unsigned pos) {
+        return mPassable.test(pos) || mFloor[pos] == TILE_CLOSED_DOOR;
+    });
+}
+
+const DistanceMap& Dungeon::playerDistances(const Coord &playerPos) {
+    if (playerPos != mPlayerDistancesFrom || mPlayerDistancesVersion != mTerrainVersion) {
+        mPlayerDistances.calculate(std::vector<Coord>{ playerPos }, [this](unsigned pos) {
+            return mPassable.test(pos);
+        });
+        mPlayerDistancesFrom = playerPos;
+        mPlayerDistancesVersion = mTerrainVersion;
+    }
+    return mPlayerDistances;
+}
+
+bool Dungeon::canSee(const Coord &from, const Coord &to) {
+    // a long session on one level could otherwise pile up every pair of
+    // positions anything ever stood at
+    const unsigned maxCachedSights = 65536;
+    if (!isValidPosition(from) || !isValidPosition(to)) return false;
+    if (mSightVersion != mTerrainVersion || mSightCache.size() >= maxCachedSights) {
+        mSightCache.clear();
+        mSightVersion = mTerrainVersion;
+    }
+    uint64_t key = static_cast<uint64_t>(toPosition(from)) << 32 | toPosition(to);
+    auto iter = mSightCache.find(key);
+    if (iter != mSightCache.end()) return iter->second;
+    bool result = lineIsClear(*this, from, to);
+    mSightCache.insert(std::make_pair(key, result));
+    return result;
+}
+
+void Dungeon::actorsThatSee(const Coord &where, std::vector<Actor*> &seers) {
+    seers.clear();
+    for (Actor *actor : mActors) {
+        if (actor->isDead() || actor->position == where) continue;
+        if (canSee(actor->position, where)) seers.push_back(actor);
     }
 }
 
 Coord Dungeon::nearestOpenTile(const Coord &source, bool allowActor, bool allowItem) const {
     if (!isValidPosition(source)) return Coord(-1, -1);
-    const MapTile *originTile = at(source);
-    const TileData &originData = getTileData(originTile->floor);
-    if ( (allowActor || !originTile->actor) &&
-         (allowItem || originTile->items.empty()) &&
-         (originData.isPassable)) return source;
+    if ( (allowActor || !actorAt(source)) &&
+         (allowItem || !itemAt(source)) &&
+         (isPassable(source))) return source;
 
     Direction dir = Direction::North;
     do {
         bool isGood = true;
-        const MapTile *tile = at(source.shift(dir));
-        if (tile) {
-            const TileData &td = getTileData(tile->floor);
-            if (!td.isPassable) isGood = false;
-            if (!allowActor && tile->actor) isGood = false;
-            if (!allowItem && !tile->items.empty()) isGood = false;
-            if (isGood) return source.shift(dir);
+        Coord here = source.shift(dir);
+        if (isValidPosition(here)) {
+            if (!isPassable(here)) isGood = false;
+            if (!allowActor && actorAt(here)) isGood = false;
+            if (!allowItem && itemAt(here)) isGood = false;
+            if (isGood) return here;
         }
         dir = rotate45(dir);
     } while (dir != Direction::North);
@@ -153,46 +178,33 @@ Coord Dungeon::nearestOpenTile(const Coord &source, bool allowActor, bool allowI
     return Coord(-1, -1);
 }
 
-Coord Dungeon::randomOpenTile(bool allowActor, bool allowItem) const {
-    int x, y, iterations = 10000;
-    bool isValid;
-    do {
-        --iterations;
-        isValid = false;
-        x = 1 + (globalRNG.upto(mWidth - 2));
-        y = 1 + (globalRNG.upto(mHeight - 2));
-        const MapTile *tile = at(Coord(x, y));
-        if (!tile) continue;
-        if (tile->actor) continue;
-        const TileData &td = getTileData(tile->floor);
-        if (!td.isPassable) continue;
-        isValid = true;
-    } while (iterations > 0 && !isValid);
-    if (isValid) return Coord(x, y);
+// Picks from the list of passable tiles, giving up after a number of tries
+// land on ones that are occupied.
+Coord Dungeon::randomOpenTile(RNG &rng, bool allowActor, bool allowItem) const {
+    if (mPassablePositions.empty()) return Coord(-1, -1);
+    for (int iterations = 0; iterations < 100; ++iterations) {
+        unsigned pos = mPassablePositions[rng.upto(mPassablePositions.size())];
+        Coord here(pos % mWidth, pos / mWidth);
+        if (!allowActor && actorAt(here)) continue;
+        if (!allowItem && itemAt(here)) continue;
+        return here;
+    }
     return Coord(-1, -1);
 }
 
-Coord Dungeon::randomOfTile(int theTile) const {
-    int x, y, iterations = 10000;
-    bool isValid;
-    do {
-        x = 1 + (globalRNG.upto(mWidth - 2));
-        y = 1 + (globalRNG.upto(mHeight - 2));
-        const MapTile *tile = at(Coord(x, y));
-        isValid = tile && tile->floor == theTile;
-    } while (iterations > 0 && !isValid);
-    if (isValid) return Coord(x, y);
-    return Coord(-1, -1);
+Coord Dungeon::randomOfTile(RNG &rng, int theTile) const {
+    if (theTile < 0 || theTile > MAX_TILE_IDENT) return Coord(-1, -1);
+    const std::vector<unsigned> &positions = mTilePositions[theTile];
+    if (positions.empty()) return Coord(-1, -1);
+    unsigned pos = positions[rng.upto(positions.size())];
+    return Coord(pos % mWidth, pos / mWidth);
 }
 
 Coord Dungeon::firstOfTile(int theTile) const {
-    for (int y = 0; y < MAP_HEIGHT; ++y) {
-        for (int x = 0; x < MAP_WIDTH; ++x) {
-            Coord here(x, y);
-            if (floorAt(here) == theTile) return here;
-        }
-    }
-    return Coord(-1, -1);
+    auto iter = std::find(mFloor.begin(), mFloor.end(), theTile);
+    if (iter == mFloor.end()) return Coord(-1, -1);
+    unsigned pos = iter - mFloor.begin();
+    return Coord(pos % mWidth, pos / mWidth);
 }
 
 
@@ -209,110 +221,160 @@ unsigned Dungeon::toPosition(const Coord &where) const {
 
 
 int Dungeon::distanceAt(const Coord &where) const {
-    const MapTile *tile = at(where);
-    if (!tile) return -1;
-    return tile->distanceValue;
+    return mDistances.at(where);
 }
 
 int Dungeon::floorAt(const Coord &where) const {
-    const MapTile *tile = at(where);
-    if (!tile) return TILE_UNASSIGNED;
-    return tile->floor;
+    if (!isValidPosition(where)) return TILE_UNASSIGNED;
+    return mFloor[toPosition(where)];
 }
 
 void Dungeon::floorAt(const Coord &where, int toTile) {
-    MapTile *tile = at(where);
-    if (!tile) return;
-    tile->floor = toTile;
+    if (!isValidPosition(where)) return;
+    setFloor(toPosition(where), toTile);
+}
+
+void Dungeon::setFloor(unsigned pos, int toTile) {
+    uint8_t fromTile = mFloor[pos];
+    if (fromTile != static_cast<uint8_t>(toTile)) {
+        ++mTerrainVersion;
+        // move the last position in the old tile's list into the gap left by
+        // this one, then add this one to the end of the new tile's list
+        std::vector<unsigned> &oldPositions = mTilePositions[fromTile];
+        unsigned slot = mTileSlot[pos];
+        oldPositions[slot] = oldPositions.back();
+        mTileSlot[oldPositions[slot]] = slot;
+        oldPositions.pop_back();
+        std::vector<unsigned> &newPositions = mTilePositions[static_cast<uint8_t>(toTile)];
+        mTileSlot[pos] = newPositions.size();
+        newPositions.push_back(pos);
+    }
+    mFloor[pos] = toTile;
+    unsigned flags = getTileFlags(toTile);
+    mOpaque.set(pos, flags & TF_OPAQUE);
+    mOpaqueColumns.set((pos % mWidth) * mHeight + pos / mWidth, flags & TF_OPAQUE);
+    bool passable = flags & TF_PASSABLE;
+    if (passable != mPassable.test(pos)) {
+        if (passable) {
+            mPassableSlot[pos] = mPassablePositions.size();
+            mPassablePositions.push_back(pos);
+        } else {
+            unsigned slot = mPassableSlot[pos];
+            mPassablePositions[slot] = mPassablePositions.back();
+            mPassableSlot[mPassablePositions[slot]] = slot;
+            mPassablePositions.pop_back();
+        }
+        mPassable.set(pos, passable);
+    }
 }
 
-const MapTile* Dungeon::at(const Coord &where) const {
-    if (!mData) return nullptr;
-    if (!isValidPosition(where)) return nullptr;
-    unsigned pos = toPosition(where);
-    if (pos >= static_cast<unsigned>(mWidth) * static_cast<unsigned>(mHeight)) return nullptr;
-    return &mData[pos];
+void Dungeon::refreshTileFlags() {
+    unsigned size = mFloor.size();
+    ++mTerrainVersion;
+    for (std::vector<unsigned> &positions : mTilePositions) positions.clear();
+    mPassablePositions.clear();
+    for (unsigned i = 0; i < size; ++i) {
+        std::vector<unsigned> &positions = mTilePositions[mFloor[i]];
+        mTileSlot[i] = positions.size();
+        positions.push_back(i);
+        unsigned flags = getTileFlags(mFloor[i]);
+        mOpaque.set(i, flags & TF_OPAQUE);
+        mPassable.set(i, flags & TF_PASSABLE);
+        mOpaqueColumns.set((i % mWidth) * mHeight + i / mWidth, flags & TF_OPAQUE);
+        if (flags & TF_PASSABLE) {
+            mPassableSlot[i] = mPassablePositions.size();
+            mPassablePositions.push_back(i);
+        }
+    }
 }
-MapTile* Dungeon::at(const Coord &where) {
-    if (!mData) return nullptr;
-    if (!isValidPosition(where)) return nullptr;
-    unsigned pos = toPosition(where);
-    if (pos >= static_cast<unsigned>(mWidth) * static_cast<unsigned>(mHeight)) return nullptr;
-    return &mData[pos];
+
+// positions off the map are treated as unassigned tiles, the same as floorAt
+bool Dungeon::isOpaque(const Coord &where) const {
+    if (!isValidPosition(where)) return getTileFlags(TILE_UNASSIGNED) & TF_OPAQUE;
+    return mOpaque.test(toPosition(where));
+}
+
+bool Dungeon::isPassable(const Coord &where) const {
+    if (!isValidPosition(where)) return getTileFlags(TILE_UNASSIGNED) & TF_PASSABLE;
+    return mPassable.test(toPosition(where));
+}
+
+int Dungeon::temperatureAt(const Coord &where) const {
+    if (!isValidPosition(where)) return 0;
+    return mTemperature[toPosition(where)];
+}
+
+void Dungeon::temperatureAt(const Coord &where, int toTemperature) {
+    if (!isValidPosition(where)) return;
+    mTemperature[toPosition(where)] = toTemperature;
 }
 
 bool Dungeon::isSeen(const Coord &where) const {
-    const MapTile *tile = at(where);
-    if (tile) return tile->isSeen;
-    return false;
+    if (!isValidPosition(where)) return false;
+    return mSeen.test(toPosition(where));
 }
 
 bool Dungeon::everSeen(const Coord &where) const {
-    const MapTile *tile = at(where);
-    if (tile) return tile->everSeen;
-    return false;
+    if (!isValidPosition(where)) return false;
+    return mEverSeen.test(toPosition(where));
 }
 
 void Dungeon::setSeen(const Coord &where) {
-    MapTile *tile = at(where);
-    if (tile) {
-        tile->isSeen = true;
-        tile->everSeen = true;
-    }
+    if (!isValidPosition(where)) return;
+    mSeen.set(toPosition(where));
 }
 
 void Dungeon::clearIsSeen() {
-    unsigned count = mWidth * mHeight;
-    for (unsigned i = 0; i < count; ++i) {
-        mData[i].isSeen = false;
-    }
+    mSeen.clear();
+    mSeenFrom = Coord(-1, -1);
 }
 
+// tiles marked as seen by the FOV pass are only folded into everSeen once it
+// completes. what can be seen depends only on where it's seen from and which
+// tiles block sight, so it's left alone if neither has changed since the last
+// time
 void Dungeon::doActorFOV(Actor *actor) {
+    if (actor->position == mSeenFrom && mSeenVersion == mTerrainVersion) return;
     clearIsSeen();
     handlePlayerFOV(this, actor);
+    mEverSeen.merge(mSeen);
+    mSeenFrom = actor->position;
+    mSeenVersion = mTerrainVersion;
 }
 
 bool Dungeon::hostileIsVisible() const {
-    for (int y = 0; y < mHeight; ++y) {
-        for (int x = 0; x < mWidth; ++x) {
-            Coord here(x, y);
-            if (!isSeen(here)) continue;
-            const Actor *who = actorAt(here);
-            if (!who || who->isPlayer) continue;
-            return true;
-        }
+    for (unsigned pos : mSeen) {
+        const Actor *who = mOccupant[pos];
+        if (!who || who->isPlayer) continue;
+        return true;
     }
     return false;
 }
 
 bool Dungeon::addActor(Actor *who, const Coord &where) {
     if (!who) return false;
-    MapTile *tile = at(where);
-    if (!tile || tile->actor) return false;
-    tile->actor = who;
+    if (!isValidPosition(where) || actorAt(where)) return false;
+    mOccupant[toPosition(where)] = who;
     who->position = where;
     who->onMap = this;
     mActors.push_back(who);
+    mSchedule.add(who);
     return true;
 }
 
 bool Dungeon::moveActor(Actor *who, const Coord &where) {
     if (!who) return false;
-    MapTile *oldTile = at(who->position);
-    MapTile *newTile = at(where);
-    if (!oldTile || !newTile || oldTile->actor != who || newTile->actor) return false;
-    oldTile->actor = nullptr;
-    newTile->actor = who;
+    if (!isValidPosition(who->position) || !isValidPosition(where)) return false;
+    if (actorAt(who->position) != who || actorAt(where)) return false;
+    mOccupant[toPosition(who->position)] = nullptr;
+    mOccupant[toPosition(where)] = who;
     who->position = where;
     return true;
 }
 
 bool Dungeon::tryActorStep(Actor *who, Direction dir) {
     Coord dest = who->position.shift(dir);
-    int newFloor = floorAt(dest);
-    const TileData &td = getTileData(newFloor);
-    if (!td.isPassable) return false;
+    if (!isPassable(dest)) return false;
     return moveActor(who, dest);
 }
 
@@ -328,9 +390,9 @@ bool Dungeon::tryActorStepApprox(Actor *who, Direction dir) {
 
 bool Dungeon::removeActor(Actor *who) {
     if (!who) return false;
-    MapTile *tile = at(who->position);
-    if (!tile) return false;
-    if (tile->actor == who) tile->actor = nullptr;
+    if (!isValidPosition(who->position)) return false;
+    if (actorAt(who->position) == who) mOccupant[toPosition(who->position)] = nullptr;
+    mSchedule.remove(who);
     auto iter = mActors.begin();
     while (iter != mActors.end()) {
         if (*iter == who) {
@@ -345,57 +407,68 @@ bool Dungeon::removeActor(Actor *who) {
 }
 
 const Actor* Dungeon::actorAt(const Coord &where) const {
-    const MapTile *tile = at(where);
-    if (!tile) return nullptr;
-    return tile->actor;
+    if (!isValidPosition(where)) return nullptr;
+    return mOccupant[toPosition(where)];
 }
 Actor* Dungeon::actorAt(const Coord &where) {
-    MapTile *tile = at(where);
-    if (!tile) return nullptr;
-    return tile->actor;
+    if (!isValidPosition(where)) return nullptr;
+    return mOccupant[toPosition(where)];
 }
 
 void Dungeon::resetSpeedCounter() {
     for (Actor *actor : mActors) {
         actor->speedCounter = 0;
     }
+    mSchedule.rebuild();
+}
+
+void Dungeon::updateSchedule(Actor *who) {
+    mSchedule.update(who);
 }
 
 bool Dungeon::addItem(Item *what, const Coord &where) {
     if (!what) return false;
-    MapTile *tile = at(where);
-    if (!tile) return false;
-    tile->items.push_back(what);
+    if (!isValidPosition(where)) return false;
+    mItems[toPosition(where)].push_back(what);
     what->position = where;
     return true;
 }
 
 bool Dungeon::removeItem(Item *what) {
     if (!what) return false;
-    MapTile *tile = at(what->position);
-    if (!tile) return false;
-    for (auto iter = tile->items.begin(); iter != tile->items.end(); ) {
-        if (*iter == what) {
-            iter = tile->items.erase(iter);
-        } else {
-            ++iter;
+    if (!isValidPosition(what->position)) return false;
+    auto itemList = mItems.find(toPosition(what->position));
+    if (itemList != mItems.end()) {
+        std::vector<Item*> &items = itemList->second;
+        for (auto iter = items.begin(); iter != items.end(); ) {
+            if (*iter == what) {
+                iter = items.erase(iter);
+            } else {
+                ++iter;
+            }
         }
+        if (items.empty()) mItems.erase(itemList);
     }
     what->position = Coord(-1, -1);
     return true;
 }
 
 const Item* Dungeon::itemAt(const Coord &where) const {
-    const MapTile *tile = at(where);
-    if (!tile) return nullptr;
-    if (tile->items.empty()) return nullptr;
-    return tile->items.front();
+    const std::vector<Item*> &items = itemsAt(where);
+    if (items.empty()) return nullptr;
+    return items.front();
 }
 Item* Dungeon::itemAt(const Coord &where) {
-    MapTile *tile = at(where);
-    if (!tile) return nullptr;
-    if (tile->items.empty()) return nullptr;
-    return tile->items.front();
+    const std::vector<Item*> &items = itemsAt(where);
+    if (items.empty()) return nullptr;
+    return items.front();
+}
+
+const std::vector<Item*>& Dungeon::itemsAt(const Coord &where) const {
+    if (!isValidPosition(where)) return NO_ITEMS;
+    auto itemList = mItems.find(toPosition(where));
+    if (itemList == mItems.end()) return NO_ITEMS;
+    return itemList->second;
 }
 
 
@@ -431,10 +504,10 @@ void Dungeon::clearDeadActors() {
     while (iter != mActors.end()) {
         if (!(*iter)->isPlayer && (*iter)->isDead()) {
             Actor *corpse = *iter;
-            MapTile *tile = at(corpse->position);
             // we don't use `removeActor` here because it would invalidate
             // the iterator from this loop
-            if (tile->actor == corpse) tile->actor = nullptr;
+            if (actorAt(corpse->position) == corpse) mOccupant[toPosition(corpse->position)] = nullptr;
+            mSchedule.remove(corpse);
             iter = mActors.erase(iter);
             delete corpse;
         } else {
@@ -444,16 +517,7 @@ void Dungeon::clearDeadActors() {
 }
 
 Actor* Dungeon::getNextActor() {
-    Actor *next = nullptr;
-    for (Actor *actor : mActors) {
-        if (actor == nullptr) continue;
-        else if (actor->health <= 0) continue; // skip dead actors
-        else if (next == nullptr) next = actor;
-        else {
-            if (actor->speedCounter < next->speedCounter) next = actor;
-        }
-    }
-    return next;
+    return mSchedule.next();
 }
 
 unsigned Dungeon::getHighestSpeedCounter() const {
@@ -475,7 +539,7 @@ void Dungeon::tick(World &world) {
         if (turnCount >= refreshFrequency) {
             turnCount = 0;
             if (mActors.size() < data.actorCount / 2) {
-                spawnActors(*this, true);
+                spawnActors(*this, world.aiRNG, true);
             }
         }
 
@@ -503,7 +567,7 @@ void Dungeon::tick(World &world) {
                     continue;
                 }
                 if (effect.trigger != ET_ON_TICK) continue;
-                std::string resultString = triggerEffect(effect, status->fromWho, actor);
+                std::string resultString = triggerEffect(effect, status->fromWho, actor, world.combatRNG);
                 if (!resultString.empty()) {
                     msg << ucFirst(actor->getName()) << " is effected by " << status->data.name << ". ";
                     msg << resultString;
@@ -513,6 +577,7 @@ void Dungeon::tick(World &world) {
             // check for effect expiry
             if (status->duration >= status->data.maxDuration) {
                 statusIter = actor->statusEffects.erase(statusIter);
+                actor->invalidateStats();
                 if (actor->isPlayer) {
                     if (actor->isPlayer) msg << "Your [color=yellow]" << status->data.name << "[/color] fades. ";
                     else msg << ucFirst(actor->getName(true)) + "'s " << status->data.name << " fades. ";
@@ -522,7 +587,7 @@ void Dungeon::tick(World &world) {
         for (const MutationItem *mutationItem : actor->mutations) {
             for (const EffectData &effect : mutationItem->data.effects) {
                 if (effect.trigger != ET_ON_TICK) continue;
-                std::string resultString = triggerEffect(effect, actor, nullptr);
+                std::string resultString = triggerEffect(effect, actor, nullptr, world.combatRNG);
                 if (!resultString.empty()) {
                     msg << resultString;
                 }
@@ -552,16 +617,23 @@ void Dungeon::tick(World &world) {
         }
 
         actor->advanceSpeedCounter();
-        const MapTile *tile = at(actor->position);
-        if (tile && tile->isSeen) {
+        if (canSee(actor->position, world.player->position)) {
             double dist = actor->position.distanceTo(world.player->position);
             if (dist < 2) {
-                AttackData attackData = actor->meleeAttack(world.player);
+                AttackData attackData = actor->meleeAttack(world.player, world.combatRNG);
                 world.addMessage(buildCombatMessage(actor, world.player, attackData, configData.getBoolValue("show_combat_math", false)));
             } else {
                 actor->playerLastSeenPosition = world.player->position;
                 Direction dirToPlayer = actor->position.directionTo(world.player->position);
-                tryActorStepApprox(actor, dirToPlayer);
+                // follow the distances back to the player so that walls in
+                // the way get walked around rather than into
+                const DistanceMap &toPlayer = playerDistances(world.player->position);
+                Direction step = toPlayer.stepToward(actor->position, dirToPlayer, [this](const Coord &where) {
+                    return actorAt(where) != nullptr;
+                });
+                if (step == Direction::Unknown || !tryActorStep(actor, step)) {
+                    tryActorStepApprox(actor, dirToPlayer);
+                }
             }
         } else {
             Coord oldPos = actor->position;
@@ -569,8 +641,8 @@ void Dungeon::tick(World &world) {
                 Direction dirToPlayer = actor->position.directionTo(actor->playerLastSeenPosition);
                 bool result = tryActorStepApprox(actor, dirToPlayer);
                 if (!result || actor->position == actor->playerLastSeenPosition) actor->playerLastSeenPosition.x = -1;
-            } else if (globalRNG.upto(2)) {
-                Direction dir = randomDirection();
+            } else if (world.aiRNG.upto(2)) {
+                Direction dir = randomDirection(world.aiRNG);
                 tryActorStepApprox(actor, dir);
             }
             Coord newPos = actor->position;
@@ -580,18 +652,29 @@ void Dungeon::tick(World &world) {
 }
 
 void Dungeon::clearFovCalc() {
-    for (int y = 0; y < MAP_HEIGHT; ++y) {
-        for (int x = 0; x < MAP_WIDTH; ++x) {
-            MapTile *tile = at(Coord(x, y));
-            if (tile) tile->inFovCalc = false;
-        }
+    if (mFovCalcFirst <= mFovCalcLast) mFovCalc.clear(mFovCalcFirst, mFovCalcLast + 1);
+    mFovCalcFirst = mFovCalc.size();
+    mFovCalcLast = 0;
+}
+
+bool Dungeon::inFovCalc(const Coord &where) const {
+    if (!isValidPosition(where)) return false;
+    return mFovCalc.test(toPosition(where));
+}
+
+void Dungeon::setFovCalc(const Coord &where, bool inCalc) {
+    if (!isValidPosition(where)) return;
+    unsigned pos = toPosition(where);
+    mFovCalc.set(pos, inCalc);
+    if (inCalc) {
+        if (pos < mFovCalcFirst) mFovCalcFirst = pos;
+        if (pos > mFovCalcLast) mFovCalcLast = pos;
     }
-    return;
 }
 
-std::vector<Coord> Dungeon::getEffectArea(const Coord &origin, const Coord &target, int areaType, int maxRange, bool includeWalls, bool includeOrigin) {
-    std::vector<Coord> result;
-    if (areaType == AR_PASSIVE || areaType == AR_NONE) return result;
+void Dungeon::getEffectArea(const Coord &origin, const Coord &target, int areaType, int maxRange, bool includeWalls, bool includeOrigin, EffectArea &area) {
+    area.reset(mWidth, mHeight);
+    if (areaType == AR_PASSIVE || areaType == AR_NONE) return;
     switch(areaType) {
         case AR_CONE: {
             Direction areaDirection = origin.directionTo(target);
@@ -603,15 +686,12 @@ std::vector<Coord> Dungeon::getEffectArea(const Coord &origin, const Coord &targ
             fovCalcBurst(this, origin, maxRange);
             break;
         case AR_LINE:
-            result = calcLine(*this, origin, target, true, true);
-            for (auto iter = result.begin(); iter != result.end(); ) {
-                if (!isValidPosition(*iter)) iter = result.erase(iter);
-                else if (!includeOrigin && *iter == origin) iter = result.erase(iter);
-                else {
-                    const MapTile *tile = at(*iter);
-                    if (getTileData(tile->floor).isOpaque) iter = result.erase(iter);
-                    else ++iter;
-                }
+            calcLine(*this, origin, target, true, true, mLine);
+            for (const Coord &here : mLine) {
+                if (!isValidPosition(here)) continue;
+                if (!includeOrigin && here == origin) continue;
+                if (isOpaque(here)) continue;
+                area.add(here);
             }
             break;
         default:
@@ -619,29 +699,17 @@ std::vector<Coord> Dungeon::getEffectArea(const Coord &origin, const Coord &targ
     }
 
     if (areaType == AR_CONE || areaType == AR_BURST) {
-        for (int y = 0; y < mHeight; ++y) {
-            for (int x = 0; x < mWidth; ++x) {
-                Coord here(x, y);
-                const MapTile *tile = at(here);
-                if (tile && tile->inFovCalc) {
-                    if (!includeOrigin && here == origin) continue;
-                    if (!includeWalls && getTileData(tile->floor).isOpaque) continue;
-                    result.push_back(here);
-                }
-            }
+        // only the part of the plane the calculation touched needs walking
+        for (unsigned pos : mFovCalc.span(mFovCalcFirst, mFovCalcLast + 1)) {
+            Coord here(pos % mWidth, pos / mWidth);
+            if (!includeOrigin && here == origin) continue;
+            if (!includeWalls && mOpaque.test(pos)) continue;
+            area.add(here);
         }
     }
-    return result;
 }
 
-bool Dungeon::inOverlay(const Coord &where) const {
-    for (const Coord &pos : overlayTiles) {
-        if (pos == where) return true;
-    }
-    return false;
-}
-
-void Dungeon::activateAbility(World &world, unsigned ident, const Coord &cursorPos, const std::vector<Coord> &targetArea) {
+void Dungeon::activateAbility(World &world, unsigned ident, const Coord &cursorPos, const EffectArea &targetArea) {
     const AbilityData &data = getAbilityData(ident);
     if (data.ident == BAD_VALUE) {
         world.addMessage("Tried to use invalid ability");
@@ -657,11 +725,11 @@ void Dungeon::activateAbility(World &world, unsigned ident, const Coord &cursorP
     std::string message = "[color=yellow]You[/color] use your [color=yellow]" + data.name + "[/color]. ";
     if (data.areaType == AR_NONE) {
         for (const EffectData &effect : data.effects) {
-            message += triggerEffect(effect, world.player, world.player);
+            message += triggerEffect(effect, world.player, world.player, world.combatRNG);
         }
     } else {
         if (!data.noEffectAnim) {
-            overlayTiles = targetArea;
+            overlayTiles = targetArea.tiles();
             overlayR = data.effectR;
             overlayG = data.effectG;
             overlayB = data.effectB;
@@ -672,7 +740,7 @@ void Dungeon::activateAbility(World &world, unsigned ident, const Coord &cursorP
             if (!actor) continue;
 
             for (const EffectData &effect : data.effects) {
-                message += triggerEffect(effect, world.player, actor);
+                message += triggerEffect(effect, world.player, actor, world.combatRNG);
             }
         }
     }
@@ -687,13 +755,15 @@ bool Dungeon::loadMapFromFile(const std::string &filename) {
     unsigned mapDataSize = mWidth * mHeight;
     for (Actor *actor : mActors) delete actor;
     mActors.clear();
+    mSchedule = ActorScheduler();
     mRooms.clear();
-    for (unsigned i = 0; i < mapDataSize; ++i) {
-        for (Item *item : mData[i].items) delete item;
-        mData[i].items.clear();
-        mData[i].actor = nullptr;
-        mData[i].floor = TILE_UNASSIGNED;
+    for (auto &itemList : mItems) {
+        for (Item *item : itemList.second) delete item;
     }
+    mItems.clear();
+    std::fill(mOccupant.begin(), mOccupant.end(), nullptr);
+    std::fill(mFloor.begin(), mFloor.end(), TILE_UNASSIGNED);
+    refreshTileFlags();
 
     std::map<int, int> tileMap{
         { '#', TILE_WALL },
@@ -726,7 +796,7 @@ bool Dungeon::loadMapFromFile(const std::string &filename) {
                 if (iter == tileMap.end()) {
                     logMessage(LOG_ERROR, filename + " has unrecognized map symbol " + c);
                 } else {
-                    mData[mapPos].floor = iter->second;
+                    setFloor(mapPos, iter->second);
                     ++mapPos;
                 }
             }
@@ -740,6 +810,66 @@ bool Dungeon::loadMapFromFile(const std::string &filename) {
     return true;
 }
 
+void Dungeon::saveLevel(SaveFile &save) const {
+    save.writeRuns(mFloor);
+    std::vector<uint8_t> plane(mTemperature.begin(), mTemperature.end());
+    save.writeRuns(plane);
+    for (unsigned i = 0; i < plane.size(); ++i) plane[i] = mEverSeen.test(i);
+    save.writeRuns(plane);
+
+    save.writeInt(mRooms.size());
+    for (const Room &room : mRooms) {
+        save.writeInt(room.type);
+        save.writeCoord(Coord(room.x, room.y));
+        save.writeCoord(Coord(room.w, room.h));
+        save.writeByte(static_cast<unsigned>(room.roomDirection));
+        save.writeByte(room.isFilled);
+    }
+
+    unsigned itemCount = 0;
+    for (const auto &itemList : mItems) itemCount += itemList.second.size();
+    save.writeInt(itemCount);
+    for (const auto &itemList : mItems) {
+        for (const Item *item : itemList.second) save.writeItem(item);
+    }
+}
+
+bool Dungeon::loadLevel(SaveFile &save) {
+    save.readRuns(mFloor);
+    refreshTileFlags();
+    std::vector<uint8_t> plane(mTemperature.size());
+    save.readRuns(plane);
+    for (unsigned i = 0; i < plane.size(); ++i) mTemperature[i] = static_cast<int8_t>(plane[i]);
+    save.readRuns(plane);
+    for (unsigned i = 0; i < plane.size(); ++i) mEverSeen.set(i, plane[i]);
+
+    unsigned roomCount = save.readInt();
+    for (unsigned i = 0; i < roomCount && !save.hasError(); ++i) {
+        Room room;
+        room.type = save.readInt();
+        Coord pos = save.readCoord();
+        Coord size = save.readCoord();
+        room.x = pos.x;
+        room.y = pos.y;
+        room.w = size.x;
+        room.h = size.y;
+        room.roomDirection = static_cast<Direction>(save.readByte());
+        room.isFilled = save.readByte();
+        mRooms.push_back(room);
+    }
+
+    unsigned itemCount = save.readInt();
+    for (unsigned i = 0; i < itemCount && !save.hasError(); ++i) {
+        Item *item = save.readItem();
+        if (!item) break;
+        if (!addItem(item, item->position)) {
+            save.setError();
+            delete item;
+        }
+    }
+    return !save.hasError();
+}
+
 std::string makeItemList(const std::vector<Item*> &itemList, unsigned maxList) {
     if (itemList.empty()) return "nothing";
     if (itemList.size() == 1) return itemList.front()->getName();
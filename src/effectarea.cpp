@@ -0,0 +1,22 @@
+#include "morph.h"
+
+
+void EffectArea::reset(int width, int height) {
+    if (width != mWidth || height != mHeight) {
+        mWidth = width;
+        mHeight = height;
+        mMask.resize(width * height);
+    } else {
+        // only the bits that were set need clearing
+        for (const Coord &where : mTiles) mMask.reset(where.x + where.y * mWidth);
+    }
+    mTiles.clear();
+}
+
+void EffectArea::add(const Coord &where) {
+    if (where.x < 0 || where.y < 0 || where.x >= mWidth || where.y >= mHeight) return;
+    unsigned pos = where.x + where.y * mWidth;
+    if (mMask.test(pos)) return;
+    mMask.set(pos);
+    mTiles.push_back(where);
+}
@@ -4,20 +4,20 @@
 
 #include "morph.h"
 
-std::string triggerEffect(const EffectData &effect, Actor *user, Actor *target) {
+std::string triggerEffect(const EffectData &effect, Actor *user, Actor *target, RNG &rng) {
     if (!user) {
         logMessage(LOG_ERROR, "Tried to trigger effect with no user.");
         return "";
     }
     if (!target) target = user;
-    if (globalRNG.upto(100) >= effect.effectChance) return "";
+    if (rng.upto(100) >= effect.effectChance) return "";
 
     switch (effect.effectId) {
         case EFFECT_HEALING: {
             int max = effect.effectParam;
             int min = effect.effectStrength;
             int range = max - min;
-            int amount = globalRNG.upto(range) + min;
+            int amount = rng.upto(range) + min;
             if (amount < 1) amount = 1;
             target->takeDamage(-amount, user);
             return "[color=yellow]" + ucFirst(target->getName(true)) + "[/color] received [color=green]" + std::to_string(amount) + "[/color] healing. ";
@@ -26,7 +26,7 @@ std::string triggerEffect(const EffectData &effect, Actor *user, Actor *target)
             int max = effect.effectParam;
             int min = effect.effectStrength;
             int range = max - min;
-            int amount = globalRNG.upto(range) + min;
+            int amount = rng.upto(range) + min;
             if (amount < 1) amount = 1;
             target->spendEnergy(-amount);
             return "[color=yellow]" + ucFirst(target->getName(true)) + "[/color] regained [color=green]" + std::to_string(amount) + "[/color] energy. ";
@@ -35,7 +35,7 @@ std::string triggerEffect(const EffectData &effect, Actor *user, Actor *target)
             int max = effect.effectParam;
             int min = effect.effectStrength;
             int range = max - min;
-            int amount = globalRNG.upto(range) + min;
+            int amount = rng.upto(range) + min;
             target->takeDamage(amount, user);
             std::string message = "[color=yellow]" + ucFirst(target->getName(true)) + "[/color] took [color=red]"
                     + std::to_string(amount) + "[/color] damage. ";
@@ -55,8 +55,8 @@ std::string triggerEffect(const EffectData &effect, Actor *user, Actor *target)
             if (itemData.ident == BAD_VALUE) {
                 return "Tried to attack with invalid item #" + std::to_string(effect.effectStrength) + ". ";
             }
-            Item *weapon = new Item(itemData);
-            AttackData result = user->meleeAttackWithWeapon(target, weapon);
+            Item *weapon = new Item(itemData, rng);
+            AttackData result = user->meleeAttackWithWeapon(target, weapon, rng);
             const std::string &resultMsg = buildCombatMessage(user, target, result, configData.getBoolValue("show_combat_math"));
             delete weapon;
             return resultMsg;
@@ -70,7 +70,7 @@ std::string triggerEffect(const EffectData &effect, Actor *user, Actor *target)
             } else {
                 std::string message;
                 if (statusData.resistDC < 1000) {
-                    int roll = globalRNG.upto(20);
+                    int roll = rng.upto(20);
                     int stat = target->getStat(STAT_TOUGHNESS);
                     message = "[[" + std::to_string(roll) + "+" + std::to_string(stat);
                     message += " vs " + std::to_string(statusData.resistDC) + "]] ";
@@ -91,14 +91,14 @@ std::string triggerEffect(const EffectData &effect, Actor *user, Actor *target)
             break; }
         case EFFECT_PURIFY: {
             if (target->mutations.empty()) return ""; // no mutations to remove
-            unsigned index = globalRNG.upto(target->mutations.size());
+            unsigned index = rng.upto(target->mutations.size());
             MutationItem *which = target->mutations[index];
             target->removeMutation(which);
             std::string message = "[color=yellow]You[/color] no longer have [color=yellow]" + which->data.name + "[/color]. ";
             delete which;
             return message; }
         case EFFECT_MUTATE: {
-            const MutationData &data = getRandomMutationData(target);
+            const MutationData &data = getRandomMutationData(target, rng);
             if (!target->hasMutation(data.ident)) {
                 target->applyMutation(new MutationItem(data));
                 return "[color=yellow]You[/color] mutate, " + data.gainVerb + " [color=yellow]" + data.name + "[/color]! ";
@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <cmath>
+#include <memory>
 #include <vector>
 #include "morph.h"
 
@@ -22,67 +24,195 @@ struct Slope  {
     int Y, X;
 };
 
-class FovCalc {
+// Lookups for a FOV calculation with a fixed range, built once per radius: which
+// cells of an octant lie within range, and which cells around the origin fall
+// within a cone pointing in each direction. Both give the same answers as the
+// distance and angle calculations they replace.
+class FovRadiusTable {
 public:
-    Dungeon *map;
-    bool forCalc;
-
-    FovCalc(Dungeon *map, bool forCalc) : map(map), forCalc(forCalc) { }
-    virtual void Compute(LevelPoint origin, int rangeLimit) = 0;
+    explicit FovRadiusTable(int radius);
 
-    /// A function that accepts the X and Y coordinates of a tile and determines
-    /// whether the given tile blocks the passage of light.
-    bool BlocksLight(int x, int y);
+    // for octant coordinates, where 0 <= y <= x
+    bool inRange(int x, int y) const {
+        return x <= mRadius && y <= mRadius && mInRange[y * (mRadius + 1) + x];
+    }
+    // the highest y in range in column x, for 0 <= x <= radius
+    int maxY(int x) const { return mMaxY[x]; }
+    // for offsets from the origin of up to the radius in each axis
+    bool inCone(int dx, int dy, Direction dir) const {
+        return mConeMask[(dy + mRadius) * (mRadius * 2 + 1) + dx + mRadius] & directionBit(dir);
+    }
+private:
+    static uint8_t directionBit(Direction dir);
 
-    /// A function that takes the X and Y coordinate of a point where X >= 0,
-    /// Y >= 0, and X >= Y, and returns the distance from the point to the origin (0,0).
-    int GetDistance(int x, int y);
+    int mRadius;
+    std::vector<uint8_t> mInRange;
+    std::vector<int> mMaxY;
+    std::vector<uint8_t> mConeMask;
+};
 
-    /// A function that sets a tile to be visible, given its X and Y coordinates.
-    void SetVisible(int x, int y);
+// tables are only built for the ranges abilities use, up to this size;
+// anything else falls back to calculating each cell
+const int MAX_FOV_TABLE_RADIUS = 64;
+static const FovRadiusTable* getFovRadiusTable(int radius);
+
+// Converts octant coordinates, where 0 <= y <= x, to offsets from the origin
+// on the map: dx = x*XX + y*XY and dy = x*YX + y*YY. Each octant is its own
+// type so the engines compile a separate loop for each with the transform
+// folded in, rather than switching on the octant for every tile.
+template<int XX, int XY, int YX, int YY>
+struct OctantTransform {
+    static int dx(int x, int y) { return x * XX + y * XY; }
+    static int dy(int x, int y) { return x * YX + y * YY; }
+
+    // whether the columns of the octant lie along rows of the map; either
+    // way, column x is map line x * lineStep from the origin's and y steps
+    // alongStep along it
+    static const bool rows = XX == 0;
+    static const int lineStep = XX == 0 ? YX : XX;
+    static const int alongStep = XX == 0 ? XY : YY;
 };
+typedef OctantTransform< 1,  0,  0, -1> Octant0;
+typedef OctantTransform< 0,  1, -1,  0> Octant1;
+typedef OctantTransform< 0, -1, -1,  0> Octant2;
+typedef OctantTransform<-1,  0,  0, -1> Octant3;
+typedef OctantTransform<-1,  0,  0,  1> Octant4;
+typedef OctantTransform< 0, -1,  1,  0> Octant5;
+typedef OctantTransform< 0,  1,  1,  0> Octant6;
+typedef OctantTransform< 1,  0,  0,  1> Octant7;
+
+// runs an engine's ComputeOctant over all eight octants
+template<class Engine>
+void computeAllOctants(Engine &engine, LevelPoint origin, int rangeLimit) {
+    engine.template ComputeOctant<Octant0>(origin, rangeLimit);
+    engine.template ComputeOctant<Octant1>(origin, rangeLimit);
+    engine.template ComputeOctant<Octant2>(origin, rangeLimit);
+    engine.template ComputeOctant<Octant3>(origin, rangeLimit);
+    engine.template ComputeOctant<Octant4>(origin, rangeLimit);
+    engine.template ComputeOctant<Octant5>(origin, rangeLimit);
+    engine.template ComputeOctant<Octant6>(origin, rangeLimit);
+    engine.template ComputeOctant<Octant7>(origin, rangeLimit);
+}
 
-class ShadowCastVisibility : public FovCalc{
+// Visit policies: where a FOV calculation records the tiles it finds visible.
+// tile() takes map coordinates, which are checked; at() and run() take map
+// positions, which must be valid, and run() covers first up to but not
+// including last.
+class SeenVisit {
 public:
-    ShadowCastVisibility(Dungeon *map, bool forCalc) : FovCalc(map, forCalc) { }
-    virtual void Compute(LevelPoint origin, int rangeLimit) override;
+    explicit SeenVisit(Dungeon *map) : map(map) { }
+    void tile(int x, int y) const { map->setSeen(Coord(x, y)); }
+    void at(unsigned pos) const { map->setSeenAt(pos); }
+    void run(unsigned first, unsigned last) const { map->setSeenRange(first, last); }
 private:
-    void Compute(uint octant, LevelPoint origin, int rangeLimit, int x, Slope top, Slope bottom);
+    Dungeon *map;
 };
 
-class DiamondWallsVisibility : public FovCalc {
+class CalcVisit {
 public:
+    explicit CalcVisit(Dungeon *map) : map(map) { }
+    void tile(int x, int y) const { map->setFovCalc(Coord(x, y), true); }
+    void at(unsigned pos) const { map->setFovCalcAt(pos); }
+    void run(unsigned first, unsigned last) const { map->setFovCalcRange(first, last); }
+private:
     Dungeon *map;
-    bool forCalc;
+};
 
-    DiamondWallsVisibility(Dungeon *map, bool forCalc) : FovCalc(map, forCalc) { }
+// Range policies: whether the tile at octant coordinates (x, y) is within
+// range of the origin, and the highest such y in column x. computeFov picks
+// one for the whole calculation, so the engines never check per tile whether
+// there is a range limit or a table for it.
+struct UnlimitedRange {
+    bool inRange(int, int) const { return true; }
+    int maxY(int x) const { return x; }
+};
 
-    void Compute(unsigned octant, LevelPoint origin, int rangeLimit, int x, Slope top, Slope bottom);
-    void Compute(LevelPoint origin, int rangeLimit);
-    bool BlocksLight(int x, int y, unsigned octant, LevelPoint origin);
+class TableRange {
+public:
+    explicit TableRange(const FovRadiusTable &table) : table(table) { }
+    bool inRange(int x, int y) const { return table.inRange(x, y); }
+    int maxY(int x) const { return table.maxY(x); }
+private:
+    const FovRadiusTable &table;
 };
 
+class DistanceRange {
+public:
+    explicit DistanceRange(int rangeLimit) : rangeLimit(rangeLimit) { }
+    // the distance from the origin is rounded down
+    bool inRange(int x, int y) const {
+        return static_cast<int>(std::sqrt(x*x + y*y)) <= rangeLimit;
+    }
+    int maxY(int x) const;
+private:
+    int rangeLimit;
+};
 
-bool FovCalc::BlocksLight(int x, int y) {
-    int tile = map->floorAt(Coord(x, y));
-    const TileData &td = getTileData(tile);
-    return td.isOpaque;
+int DistanceRange::maxY(int x) const {
+    // a tile is in range while x*x + y*y is less than (rangeLimit + 1) squared
+    int limit = (rangeLimit + 1) * (rangeLimit + 1) - x * x - 1;
+    int y = static_cast<int>(std::sqrt(limit));
+    while (y * y > limit) --y;
+    while ((y + 1) * (y + 1) <= limit) ++y;
+    return y;
 }
 
-int FovCalc::GetDistance(int x, int y) {
-    double dist = std::sqrt(x*x + y*y);
-    return dist;
-}
+template<class Visit, class Range>
+class FovCalc {
+public:
+    Dungeon *map;
+    Visit visit;
+    Range range;
 
-void FovCalc::SetVisible(int x, int y) {
-    if (forCalc) {
-        MapTile *tile = map->at(Coord(x, y));
-        if (tile) tile->inFovCalc = true;
-    } else map->setSeen(Coord(x, y));
-}
+    FovCalc(Dungeon *map, Visit visit, Range range) : map(map), visit(visit), range(range) { }
+
+    /// A function that accepts the X and Y coordinates of a tile and determines
+    /// whether the given tile blocks the passage of light.
+    bool BlocksLight(int x, int y) const {
+        return map->isOpaque(Coord(x, y));
+    }
+
+    /// A function that sets a tile to be visible, given its X and Y coordinates.
+    void SetVisible(int x, int y) {
+        visit.tile(x, y);
+    }
+};
+
+template<class Visit, class Range>
+class ShadowCastVisibility : public FovCalc<Visit, Range> {
+public:
+    ShadowCastVisibility(Dungeon *map, Visit visit, Range range) : FovCalc<Visit, Range>(map, visit, range) { }
+    void Compute(LevelPoint origin, int rangeLimit);
+
+    template<class Octant>
+    void ComputeOctant(LevelPoint origin, int rangeLimit) {
+        ComputeOctant<Octant>(origin, rangeLimit, 1, Slope(1, 1), Slope(0, 1));
+    }
+private:
+    template<class Octant>
+    void ComputeOctant(LevelPoint origin, int rangeLimit, int x, Slope top, Slope bottom);
+};
+
+template<class Visit, class Range>
+class DiamondWallsVisibility : public FovCalc<Visit, Range> {
+public:
+    DiamondWallsVisibility(Dungeon *map, Visit visit, Range range) : FovCalc<Visit, Range>(map, visit, range) { }
+    void Compute(LevelPoint origin, int rangeLimit);
 
+    template<class Octant>
+    void ComputeOctant(LevelPoint origin, int rangeLimit) {
+        ComputeOctant<Octant>(origin, rangeLimit, 1, Slope(1, 1), Slope(0, 1));
+    }
+private:
+    template<class Octant>
+    void ComputeOctant(LevelPoint origin, int rangeLimit, int x, Slope top, Slope bottom);
+    template<class Octant>
+    bool BlocksLight(int x, int y, LevelPoint origin) const;
+};
 
-void ShadowCastVisibility::Compute(uint octant, LevelPoint origin, int rangeLimit, int x, Slope top, Slope bottom)
+
+template<class Visit, class Range> template<class Octant>
+void ShadowCastVisibility<Visit, Range>::ComputeOctant(LevelPoint origin, int rangeLimit, int x, Slope top, Slope bottom)
 {
     // rangeLimit < 0 || x <= rangeLimit
     for(; (uint)x <= (uint)rangeLimit; x++) {
@@ -94,25 +224,15 @@ void ShadowCastVisibility::Compute(uint octant, LevelPoint origin, int rangeLimi
 
         int wasOpaque = -1; // 0:false, 1:true, -1:not applicable
         for(int y=topY; y >= bottomY; y--) {
-            int tx = origin.X, ty = origin.Y;
             // translate local coordinates to map coordinates
-            switch(octant) {
-                case 0: tx += x; ty -= y; break;
-                case 1: tx += y; ty -= x; break;
-                case 2: tx -= y; ty -= x; break;
-                case 3: tx -= x; ty -= y; break;
-                case 4: tx -= x; ty += y; break;
-                case 5: tx -= y; ty += x; break;
-                case 6: tx += y; ty += x; break;
-                case 7: tx += x; ty += y; break;
-            }
+            int tx = origin.X + Octant::dx(x, y), ty = origin.Y + Octant::dy(x, y);
 
-            bool inRange = rangeLimit < 0 || GetDistance(x, y) <= rangeLimit;
-            if(inRange) SetVisible(tx, ty);
+            bool inRange = this->range.inRange(x, y);
+            if(inRange) this->SetVisible(tx, ty);
             // NOTE: use the next line instead if you want the algorithm to be symmetrical
             // if(inRange && (y != topY || top.Y*x >= top.X*y) && (y != bottomY || bottom.Y*x <= bottom.X*y)) SetVisible(tx, ty);
 
-            bool isOpaque = !inRange || BlocksLight(tx, ty);
+            bool isOpaque = !inRange || this->BlocksLight(tx, ty);
             if(x != rangeLimit) {
                 if (isOpaque) {
                     // if we found a transition from clear to opaque, this sector is done in this column, so
@@ -122,7 +242,7 @@ void ShadowCastVisibility::Compute(uint octant, LevelPoint origin, int rangeLimi
                         Slope newBottom = Slope(y * 2 + 1, x * 2 - 1);
                         // don't recurse unless we have to
                         if (!inRange || y == bottomY) { bottom = newBottom; break; }
-                        else Compute(octant, origin, rangeLimit, x + 1, top, newBottom);
+                        else ComputeOctant<Octant>(origin, rangeLimit, x + 1, top, newBottom);
                     }
                     wasOpaque = 1;
                 }
@@ -140,14 +260,14 @@ void ShadowCastVisibility::Compute(uint octant, LevelPoint origin, int rangeLimi
     }
 }
 
-void ShadowCastVisibility::Compute(LevelPoint origin, int rangeLimit) {
-    SetVisible(origin.X, origin.Y);
-    for(uint octant = 0; octant < 8; octant++) {
-        Compute(octant, origin, rangeLimit, 1, Slope(1, 1), Slope(0, 1));
-    }
+template<class Visit, class Range>
+void ShadowCastVisibility<Visit, Range>::Compute(LevelPoint origin, int rangeLimit) {
+    this->SetVisible(origin.X, origin.Y);
+    computeAllOctants(*this, origin, rangeLimit);
 }
 
-void DiamondWallsVisibility::Compute(unsigned octant, LevelPoint origin, int rangeLimit, int x, Slope top, Slope bottom) {
+template<class Visit, class Range> template<class Octant>
+void DiamondWallsVisibility<Visit, Range>::ComputeOctant(LevelPoint origin, int rangeLimit, int x, Slope top, Slope bottom) {
     // rangeLimit < 0 || x <= rangeLimit
     for(; (unsigned)x <= (unsigned)rangeLimit; x++) {
         int topY;
@@ -157,7 +277,7 @@ void DiamondWallsVisibility::Compute(unsigned octant, LevelPoint origin, int ran
             // get the tile that the top vector enters from the left
             topY = ((x * 2 - 1) * top.Y + top.X) / (top.X * 2);
             int ay = (topY * 2 + 1) * top.X;
-            if (BlocksLight(x, topY, octant, origin)) { // if the top tile is a wall...
+            if (BlocksLight<Octant>(x, topY, origin)) { // if the top tile is a wall...
                 // but the top vector misses the wall and passes into the tile above, move up
                 if (top.GreaterOrEqual(ay, x*2)) topY++;
             } else { // the top tile is not a wall
@@ -169,30 +289,20 @@ void DiamondWallsVisibility::Compute(unsigned octant, LevelPoint origin, int ran
         int bottomY = bottom.Y == 0 ? 0 : ((x*2-1) * bottom.Y + bottom.X) / (bottom.X*2);
         int wasOpaque = -1; // 0:false, 1:true, -1:not applicable
         for (int y = topY; y >= bottomY; y--) {
-            int tx = origin.X, ty = origin.Y;
             // translate local coordinates to map coordinates
-            switch(octant) {
-                case 0: tx += x; ty -= y; break;
-                case 1: tx += y; ty -= x; break;
-                case 2: tx -= y; ty -= x; break;
-                case 3: tx -= x; ty -= y; break;
-                case 4: tx -= x; ty += y; break;
-                case 5: tx -= y; ty += x; break;
-                case 6: tx += y; ty += x; break;
-                case 7: tx += x; ty += y; break;
-            }
+            int tx = origin.X + Octant::dx(x, y), ty = origin.Y + Octant::dy(x, y);
 
-            bool inRange = rangeLimit < 0 || GetDistance(x, y) <= rangeLimit;
+            bool inRange = this->range.inRange(x, y);
             // NOTE: use the following line instead to make the algorithm symmetrical
-            if (inRange && (y != topY || top.GreaterOrEqual(y, x)) && (y != bottomY || bottom.LessOrEqual(y, x))) SetVisible(tx, ty);
+            if (inRange && (y != topY || top.GreaterOrEqual(y, x)) && (y != bottomY || bottom.LessOrEqual(y, x))) this->SetVisible(tx, ty);
             // if (inRange) SetVisible(tx, ty);
 
-            bool isOpaque = !inRange || FovCalc::BlocksLight(tx, ty);
+            bool isOpaque = !inRange || FovCalc<Visit, Range>::BlocksLight(tx, ty);
             // if y == topY or y == bottomY, make sure the sector actually intersects the wall tile. if not, don't consider
             // it opaque to prevent the code below from moving the top vector up or the bottom vector down
             if (isOpaque &&
-               ((y == topY && top.LessOrEqual(y*2-1, x*2) && !BlocksLight(x, y-1, octant, origin)) ||
-               (y == bottomY && bottom.GreaterOrEqual(y*2+1, x*2) && !BlocksLight(x, y+1, octant, origin)))) {
+               ((y == topY && top.LessOrEqual(y*2-1, x*2) && !BlocksLight<Octant>(x, y-1, origin)) ||
+               (y == bottomY && bottom.GreaterOrEqual(y*2+1, x*2) && !BlocksLight<Octant>(x, y+1, origin)))) {
                 isOpaque = false;
             }
 
@@ -203,7 +313,7 @@ void DiamondWallsVisibility::Compute(unsigned octant, LevelPoint origin, int ran
                     if (wasOpaque == 0) {
                         // (x*2-1, y*2+1) is a vector to the top-left corner of the opaque block
                         if (!inRange || y == bottomY) { bottom = Slope(y*2+1, x*2); break; } // don't recurse unless necessary
-                        else Compute(octant, origin, rangeLimit, x+1, top, Slope(y*2+1, x*2));
+                        else ComputeOctant<Octant>(origin, rangeLimit, x+1, top, Slope(y*2+1, x*2));
                     }
                     wasOpaque = 1;
                 } else {
@@ -219,26 +329,244 @@ void DiamondWallsVisibility::Compute(unsigned octant, LevelPoint origin, int ran
     }
 }
 
-void DiamondWallsVisibility::Compute(LevelPoint origin, int rangeLimit) {
-    SetVisible(origin.X, origin.Y);
-    for (unsigned octant = 0; octant < 8; octant++) {
-        Compute(octant, origin, rangeLimit, 1, Slope(1, 1), Slope(0, 1));
+template<class Visit, class Range>
+void DiamondWallsVisibility<Visit, Range>::Compute(LevelPoint origin, int rangeLimit) {
+    this->SetVisible(origin.X, origin.Y);
+    computeAllOctants(*this, origin, rangeLimit);
+}
+
+template<class Visit, class Range> template<class Octant>
+bool DiamondWallsVisibility<Visit, Range>::BlocksLight(int x, int y, LevelPoint origin) const {
+    return FovCalc<Visit, Range>::BlocksLight(origin.X + Octant::dx(x, y), origin.Y + Octant::dy(x, y));
+}
+
+
+/* ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****
+ * BIT-PARALLEL FOV ENGINE
+ * The same diamond walls algorithm as above, worked a column of an octant at a
+ * time instead of a tile at a time. The opacity of the column is read from the
+ * dungeon's packed planes as a word of bits; the tiles where the walk above
+ * would move its top or bottom vector or start a new sector are the places
+ * where that word changes from one bit to the next, so only those are looked
+ * at one by one. The visible tiles of the column are always a single run and
+ * are written to the target plane together. The visible set is identical, so
+ * either engine can be used to check the other.
+ * ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****/
+
+static uint64_t lowBits(int count) {
+    return count >= 64 ? ~uint64_t(0) : (uint64_t(1) << count) - 1;
+}
+
+static uint64_t reverseBits(uint64_t bits) {
+    bits = ((bits >> 1) & 0x5555555555555555ULL) | ((bits & 0x5555555555555555ULL) << 1);
+    bits = ((bits >> 2) & 0x3333333333333333ULL) | ((bits & 0x3333333333333333ULL) << 2);
+    bits = ((bits >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((bits & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    return __builtin_bswap64(bits);
+}
+
+template<class Visit, class Range>
+class BitParallelFov {
+public:
+    BitParallelFov(Dungeon *map, Visit visit, Range range)
+    : mMap(*map), mVisit(visit), mRange(range), mWidth(map->width()), mHeight(map->height()),
+      mOutsideOpaque(getTileFlags(TILE_UNASSIGNED) & TF_OPAQUE), mRangeLimit(-1)
+    { }
+
+    void Compute(LevelPoint origin, int rangeLimit);
+
+    template<class Octant>
+    void ComputeOctant(LevelPoint, int) {
+        computeOctant<Octant>(1, Slope(1, 1), Slope(0, 1));
+    }
+
+private:
+    template<class Octant>
+    void computeOctant(int x, Slope top, Slope bottom);
+
+    // column x of an octant is line lineOf(x) of the packed plane, which is a
+    // row or a column of the map, and tile y of the column lies alongOf(y)
+    // along it
+    template<class Octant>
+    const BitPlane& lines() const { return Octant::rows ? mMap.opaquePlane() : mMap.opaqueColumns(); }
+    template<class Octant>
+    int lineCount() const { return Octant::rows ? mHeight : mWidth; }
+    template<class Octant>
+    int lineLength() const { return Octant::rows ? mWidth : mHeight; }
+    template<class Octant>
+    int lineOf(int x) const { return (Octant::rows ? mOrigin.Y : mOrigin.X) + x * Octant::lineStep; }
+    template<class Octant>
+    int alongOf(int y) const { return (Octant::rows ? mOrigin.X : mOrigin.Y) + y * Octant::alongStep; }
+
+    template<class Octant>
+    bool blocksLight(int x, int y) const;
+    // bit i is the opacity of tile (x, low + i), for up to 64 tiles
+    template<class Octant>
+    uint64_t opacityBits(int x, int low, int count) const;
+    template<class Octant>
+    void setVisible(int x, int low, int high);
+
+    Dungeon &mMap;
+    Visit mVisit;
+    Range mRange;
+    int mWidth, mHeight;
+    bool mOutsideOpaque;
+    LevelPoint mOrigin;
+    int mRangeLimit;
+};
+
+template<class Visit, class Range>
+void BitParallelFov<Visit, Range>::Compute(LevelPoint origin, int rangeLimit) {
+    mOrigin = origin;
+    mRangeLimit = rangeLimit;
+    if (origin.X >= 0 && origin.Y >= 0 && origin.X < mWidth && origin.Y < mHeight) {
+        mVisit.at(origin.Y * mWidth + origin.X);
+    }
+    computeAllOctants(*this, origin, rangeLimit);
+}
+
+template<class Visit, class Range> template<class Octant>
+void BitParallelFov<Visit, Range>::computeOctant(int x, Slope top, Slope bottom) {
+    // see DiamondWallsVisibility::ComputeOctant for how the sector is followed
+    for (; (unsigned)x <= (unsigned)mRangeLimit; x++) {
+        int topY;
+        if (top.X == 1) {
+            topY = x;
+        } else {
+            topY = ((x * 2 - 1) * top.Y + top.X) / (top.X * 2);
+            int ay = (topY * 2 + 1) * top.X;
+            if (blocksLight<Octant>(x, topY)) {
+                if (top.GreaterOrEqual(ay, x*2)) topY++;
+            } else {
+                if (top.Greater(ay, x*2+1)) topY++;
+            }
+        }
+        int bottomY = bottom.Y == 0 ? 0 : ((x*2-1) * bottom.Y + bottom.X) / (bottom.X*2);
+        int maxY = mRange.maxY(x);
+
+        // the end tiles are only visible if the sector reaches their centres
+        int visibleHigh = std::min(topY, maxY);
+        if (visibleHigh == topY && !top.GreaterOrEqual(topY, x)) --visibleHigh;
+        bool bottomVisible = bottom.LessOrEqual(bottomY, x);
+
+        int wasOpaque = -1; // 0:false, 1:true, -1:not applicable
+        int lastY = bottomY;
+        if (x != mRangeLimit) {
+            bool sectorDone = false;
+            // up to 64 tiles at a time, from the top down
+            for (int high = topY; high >= bottomY && !sectorDone; ) {
+                int low = std::max(bottomY, high - 63);
+                int count = high - low + 1;
+                uint64_t opaque = opacityBits<Octant>(x, low, count);
+                // tiles out of range are treated as opaque
+                if (maxY < high) opaque |= lowBits(count) & ~lowBits(std::max(maxY + 1 - low, 0));
+                // the end tiles count as clear where the sector only clips the
+                // corner of a wall
+                uint64_t topBit = uint64_t(1) << (count - 1);
+                if (high == topY && (opaque & topBit) && top.LessOrEqual(topY*2-1, x*2) && !blocksLight<Octant>(x, topY-1)) {
+                    opaque &= ~topBit;
+                }
+                if (low == bottomY && (opaque & 1) && bottom.GreaterOrEqual(bottomY*2+1, x*2) && !blocksLight<Octant>(x, bottomY+1)) {
+                    opaque &= ~uint64_t(1);
+                }
+
+                // bit i is set where tile low+i differs from the tile above it
+                uint64_t changes = (opaque ^ (opaque >> 1)) & lowBits(count - 1);
+                if (wasOpaque >= 0 && ((opaque >> (count - 1)) & 1) != (uint64_t)wasOpaque) {
+                    changes |= uint64_t(1) << (count - 1);
+                }
+                while (changes) {
+                    int i = 63 - __builtin_clzll(changes);
+                    changes &= ~(uint64_t(1) << i);
+                    int y = low + i;
+                    if ((opaque >> i) & 1) {
+                        // clear to opaque: this sector is done in this column
+                        if (y > maxY || y == bottomY) {
+                            bottom = Slope(y*2+1, x*2);
+                            lastY = y;
+                            sectorDone = true;
+                            break;
+                        }
+                        computeOctant<Octant>(x+1, top, Slope(y*2+1, x*2));
+                    } else {
+                        // opaque to clear: move the top vector down
+                        top = Slope(y*2+1, x*2);
+                    }
+                }
+                wasOpaque = sectorDone ? 0 : opaque & 1;
+                high = low - 1;
+            }
+        }
+
+        int visibleLow = lastY;
+        if (visibleLow == bottomY && !bottomVisible) ++visibleLow;
+        if (visibleLow <= visibleHigh) setVisible<Octant>(x, visibleLow, visibleHigh);
+
+        if (wasOpaque != 0) break; // if the column ended in a clear tile, continue processing the current sector
+    }
+}
+
+template<class Visit, class Range> template<class Octant>
+bool BitParallelFov<Visit, Range>::blocksLight(int x, int y) const {
+    int line = lineOf<Octant>(x);
+    int along = alongOf<Octant>(y);
+    if (line < 0 || line >= lineCount<Octant>() || along < 0 || along >= lineLength<Octant>()) return mOutsideOpaque;
+    return lines<Octant>().test(line * lineLength<Octant>() + along);
+}
+
+template<class Visit, class Range> template<class Octant>
+uint64_t BitParallelFov<Visit, Range>::opacityBits(int x, int low, int count) const {
+    uint64_t result = mOutsideOpaque ? lowBits(count) : 0;
+    int line = lineOf<Octant>(x);
+    if (line < 0 || line >= lineCount<Octant>()) return result;
+
+    // read the tiles in the order they lie along the line, then flip them
+    // round if the octant runs the other way
+    int first = alongOf<Octant>(Octant::alongStep > 0 ? low : low + count - 1);
+    int clipFirst = std::max(first, 0);
+    int clipLast = std::min(first + count - 1, lineLength<Octant>() - 1);
+    if (clipFirst <= clipLast) {
+        int shift = clipFirst - first;
+        int clipCount = clipLast - clipFirst + 1;
+        result &= ~(lowBits(clipCount) << shift);
+        result |= lines<Octant>().bits(line * lineLength<Octant>() + clipFirst, clipCount) << shift;
+    }
+    if (Octant::alongStep < 0) result = reverseBits(result) >> (64 - count);
+    return result;
+}
+
+template<class Visit, class Range> template<class Octant>
+void BitParallelFov<Visit, Range>::setVisible(int x, int low, int high) {
+    int line = lineOf<Octant>(x);
+    if (line < 0 || line >= lineCount<Octant>()) return;
+    int first = alongOf<Octant>(Octant::alongStep > 0 ? low : high);
+    int last = first + high - low;
+    first = std::max(first, 0);
+    last = std::min(last, lineLength<Octant>() - 1);
+    if (first > last) return;
+
+    if (Octant::rows) {
+        unsigned rowStart = line * mWidth;
+        mVisit.run(rowStart + first, rowStart + last + 1);
+    } else {
+        for (int along = first; along <= last; ++along) {
+            mVisit.at(along * mWidth + line);
+        }
     }
 }
 
-bool DiamondWallsVisibility::BlocksLight(int x, int y, unsigned octant, LevelPoint origin) {
-    int nx = origin.X, ny = origin.Y;
-    switch (octant) {
-        case 0: nx += x; ny -= y; break;
-        case 1: nx += y; ny -= x; break;
-        case 2: nx -= y; ny -= x; break;
-        case 3: nx -= x; ny -= y; break;
-        case 4: nx -= x; ny += y; break;
-        case 5: nx -= y; ny += x; break;
-        case 6: nx += y; ny += x; break;
-        case 7: nx += x; ny += y; break;
+// runs a calculation with the range policy that suits rangeLimit
+template<template<class, class> class Engine, class Visit>
+void computeFov(Dungeon *map, Visit visit, LevelPoint origin, int rangeLimit) {
+    if (rangeLimit < 0) {
+        Engine<Visit, UnlimitedRange> fov(map, visit, UnlimitedRange());
+        fov.Compute(origin, rangeLimit);
+    } else if (const FovRadiusTable *table = getFovRadiusTable(rangeLimit)) {
+        Engine<Visit, TableRange> fov(map, visit, TableRange(*table));
+        fov.Compute(origin, rangeLimit);
+    } else {
+        Engine<Visit, DistanceRange> fov(map, visit, DistanceRange(rangeLimit));
+        fov.Compute(origin, rangeLimit);
     }
-    return FovCalc::BlocksLight(nx, ny);
 }
 
 
@@ -246,13 +574,30 @@ bool DiamondWallsVisibility::BlocksLight(int x, int y, unsigned octant, LevelPoi
  * GAME-SPECIFIC FOV FUNCTIONS
  * ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****/
 
+static int fovEngine = FOV_BIT_PARALLEL;
+
+void setFovEngine(int engine) {
+    if (engine != FOV_DIAMOND_WALLS && engine != FOV_BIT_PARALLEL) {
+        logMessage(LOG_ERROR, "Tried to select unknown FOV engine " + std::to_string(engine));
+        return;
+    }
+    fovEngine = engine;
+}
+
+int getFovEngine() {
+    return fovEngine;
+}
+
 void handlePlayerFOV(Dungeon *dungeon, Actor *player) {
-    DiamondWallsVisibility fov(dungeon, false);
-    // ShadowCastVisibility fov(dungeon, false);
     LevelPoint p;
     p.X = player->position.x;
     p.Y = player->position.y;
-    fov.Compute(p, -1);
+    if (fovEngine == FOV_BIT_PARALLEL) {
+        computeFov<BitParallelFov>(dungeon, SeenVisit(dungeon), p, -1);
+    } else {
+        computeFov<DiamondWallsVisibility>(dungeon, SeenVisit(dungeon), p, -1);
+        // computeFov<ShadowCastVisibility>(dungeon, SeenVisit(dungeon), p, -1);
+    }
 }
 
 const double PI_VALUE = 3.14159;
@@ -279,30 +624,99 @@ static bool validAngleForDirection(Direction dir, double angle) {
     }
 }
 
+FovRadiusTable::FovRadiusTable(int radius)
+: mRadius(radius), mInRange((radius + 1) * (radius + 1)), mMaxY(radius + 1, -1),
+  mConeMask((radius * 2 + 1) * (radius * 2 + 1))
+{
+    for (int y = 0; y <= radius; ++y) {
+        for (int x = 0; x <= radius; ++x) {
+            // matches DistanceRange, which rounds down
+            bool inRange = static_cast<int>(std::sqrt(x*x + y*y)) <= radius;
+            mInRange[y * (radius + 1) + x] = inRange;
+            if (inRange) mMaxY[x] = y;
+        }
+    }
+    const Direction directions[] = {
+        Direction::North, Direction::Northeast, Direction::East, Direction::Southeast,
+        Direction::South, Direction::Southwest, Direction::West, Direction::Northwest
+    };
+    for (int dy = -radius; dy <= radius; ++dy) {
+        for (int dx = -radius; dx <= radius; ++dx) {
+            double angle = radiansToDegrees(std::atan2(dy, dx));
+            uint8_t &mask = mConeMask[(dy + radius) * (radius * 2 + 1) + dx + radius];
+            for (Direction dir : directions) {
+                if (validAngleForDirection(dir, angle)) mask |= directionBit(dir);
+            }
+        }
+    }
+}
+
+uint8_t FovRadiusTable::directionBit(Direction dir) {
+    if (dir < Direction::North || dir > Direction::Northwest) return 0;
+    return 1 << (static_cast<int>(dir) - static_cast<int>(Direction::North));
+}
+
+// indexed by radius; filled in by buildFovTables while the game data is
+// loaded and only read after that, so any thread can use it
+static std::vector<std::unique_ptr<FovRadiusTable>> fovRadiusTables;
+
+void buildFovTables(const std::vector<int> &radii) {
+    fovRadiusTables.clear();
+    for (int radius : radii) {
+        if (radius < 0 || radius > MAX_FOV_TABLE_RADIUS) continue;
+        if (static_cast<int>(fovRadiusTables.size()) <= radius) fovRadiusTables.resize(radius + 1);
+        if (!fovRadiusTables[radius]) fovRadiusTables[radius].reset(new FovRadiusTable(radius));
+    }
+}
+
+static const FovRadiusTable* getFovRadiusTable(int radius) {
+    if (radius < 0 || radius >= static_cast<int>(fovRadiusTables.size())) return nullptr;
+    return fovRadiusTables[radius].get();
+}
+
 void fovCalcBeam(Dungeon *dungeon, const Coord &origin, Direction dir, int maxRange) {
-    DiamondWallsVisibility fov(dungeon, true);
-    LevelPoint p;
-    p.X = origin.x;
-    p.Y = origin.y;
-    fov.Compute(p, maxRange);
+    fovCalcBurst(dungeon, origin, maxRange);
+
+    const FovRadiusTable *rangeTable = getFovRadiusTable(maxRange);
+    if (rangeTable) {
+        for (int dy = -maxRange; dy <= maxRange; ++dy) {
+            for (int dx = -maxRange; dx <= maxRange; ++dx) {
+                Coord here(origin.x + dx, origin.y + dy);
+                if (!dungeon->inFovCalc(here)) continue;
+                if (!rangeTable->inCone(dx, dy, dir)) dungeon->setFovCalc(here, false);
+            }
+        }
+        return;
+    }
 
-    for (int y = 0; y < dungeon->height(); ++y) {
-        for (int x = 0; x < dungeon->width(); ++x) {
-            MapTile *mapTile = dungeon->at(Coord(x, y));
-            if (!mapTile || !mapTile->inFovCalc) continue;
+    // nothing beyond maxRange can have been reached
+    int left = 0, top = 0, right = dungeon->width() - 1, bottom = dungeon->height() - 1;
+    if (maxRange >= 0) {
+        left = std::max(left, origin.x - maxRange);
+        top = std::max(top, origin.y - maxRange);
+        right = std::min(right, origin.x + maxRange);
+        bottom = std::min(bottom, origin.y + maxRange);
+    }
+    for (int y = top; y <= bottom; ++y) {
+        for (int x = left; x <= right; ++x) {
+            Coord here(x, y);
+            if (!dungeon->inFovCalc(here)) continue;
             double angle = std::atan2(y - origin.y, x - origin.x);
             angle = radiansToDegrees(angle);
-            if (!validAngleForDirection(dir, angle)) mapTile->inFovCalc = false;
+            if (!validAngleForDirection(dir, angle)) dungeon->setFovCalc(here, false);
         }
     }
 }
 
 void fovCalcBurst(Dungeon *dungeon, const Coord &origin, int maxRange) {
-    DiamondWallsVisibility fov(dungeon, true);
     LevelPoint p;
     p.X = origin.x;
     p.Y = origin.y;
-    fov.Compute(p, maxRange);
+    if (fovEngine == FOV_BIT_PARALLEL) {
+        computeFov<BitParallelFov>(dungeon, CalcVisit(dungeon), p, maxRange);
+    } else {
+        computeFov<DiamondWallsVisibility>(dungeon, CalcVisit(dungeon), p, maxRange);
+    }
 }
 
 
@@ -312,16 +726,15 @@ void fovCalcBurst(Dungeon *dungeon, const Coord &origin, int maxRange) {
 
 static bool lineShouldStop(const Dungeon &map, const Coord &where, bool stopOpaque, bool stopSolid) {
     if (!map.isValidPosition(where)) return true;
-    int tile = map.floorAt(where);
-    const TileData &td = getTileData(tile);
-    if (stopOpaque && td.isOpaque) return true;
-    if (stopSolid && !td.isPassable) return true;
+    if (stopOpaque && map.isOpaque(where)) return true;
+    if (stopSolid && !map.isPassable(where)) return true;
     return false;
 
 }
-std::vector<Coord> calcLine(const Dungeon &map, const Coord &start, const Coord &end, bool stopOpaque, bool stopSolid) {
-    std::vector<Coord> results;
-
+// Walks the line from start toward end, and past it, passing each tile after
+// start to step until step returns false.
+template<class Step>
+static void walkLine(const Coord &start, const Coord &end, Step step) {
     int dx = end.x - start.x;
     signed char const ix = (dx > 0) - (dx < 0);
     dx = abs(dx) << 1;
@@ -330,8 +743,6 @@ std::vector<Coord> calcLine(const Dungeon &map, const Coord &start, const Coord
     signed char iy = (dy > 0) - (dy < 0);
     dy = abs(dy) << 1;
 
-    results.push_back(start);
-
     Coord pos = start;
     if (dx > dy) {
         int error = dy - (dx >> 1);
@@ -342,8 +753,7 @@ std::vector<Coord> calcLine(const Dungeon &map, const Coord &start, const Coord
             }
             error += dy;
             pos.x += ix;
-            results.push_back(pos);
-            if (lineShouldStop(map, pos, stopOpaque, stopSolid)) break;
+            if (!step(pos)) break;
         }
     } else {
         int error(dx - (dy >> 1));
@@ -354,12 +764,40 @@ std::vector<Coord> calcLine(const Dungeon &map, const Coord &start, const Coord
             }
             error += dx;
             pos.y += iy;
-            results.push_back(pos);
-            if (lineShouldStop(map, pos, stopOpaque, stopSolid)) break;
+            if (!step(pos)) break;
         }
     }
+}
 
+std::vector<Coord> calcLine(const Dungeon &map, const Coord &start, const Coord &end, bool stopOpaque, bool stopSolid) {
+    std::vector<Coord> results;
+    calcLine(map, start, end, stopOpaque, stopSolid, results);
     return results;
 }
 
+void calcLine(const Dungeon &map, const Coord &start, const Coord &end, bool stopOpaque, bool stopSolid, std::vector<Coord> &results) {
+    results.clear();
+    results.push_back(start);
+    walkLine(start, end, [&](const Coord &pos) {
+        results.push_back(pos);
+        return !lineShouldStop(map, pos, stopOpaque, stopSolid);
+    });
+}
+
+bool lineIsClear(const Dungeon &map, const Coord &start, const Coord &end) {
+    if (!map.isValidPosition(start) || !map.isValidPosition(end)) return false;
+    const BitPlane &opaque = map.opaquePlane();
+    const int width = map.width();
+    bool clear = true;
+    walkLine(start, end, [&](const Coord &pos) {
+        if (pos == end) return false;
+        if (opaque.test(pos.y * width + pos.x)) {
+            clear = false;
+            return false;
+        }
+        return true;
+    });
+    return clear;
+}
+
 
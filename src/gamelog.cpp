@@ -1,15 +1,19 @@
 #include <iostream>
+#include <mutex>
 #include <string>
 #include "physfs.h"
 #include "morph.h"
 
 
 static PHYSFS_file *logFile = nullptr;
+// levels may be generated on a background thread, which logs as it goes
+static std::mutex logLock;
 
 std::string logLevelName(int logLevel);
 
 
 void logMessage(int logLevel, std::string message) {
+    std::lock_guard<std::mutex> lock(logLock);
     if (logFile == nullptr) {
         logFile = PHYSFS_openWrite("game.log");
         if (!logFile) {
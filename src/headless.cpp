@@ -0,0 +1,48 @@
+#include <iostream>
+#include <string>
+
+#include "physfs.h"
+#include "morph.h"
+
+
+/* ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****
+ * HEADLESS INTERFACE STUBS
+ * The player action code calls back into the interface in a few places
+ * (picking from a pile of items, debug prompts). The headless tools have no
+ * one to ask, so these simply decline.
+ * ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****/
+
+void doInventory(World &world, bool showFloor) { }
+
+void ui_alertBox(const std::string &title, const std::string &message) {
+    logMessage(LOG_WARN, title + ": " + message);
+}
+
+bool ui_getString(const std::string &title, const std::string &message, std::string &result) {
+    return false;
+}
+
+
+/* ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****
+ * Set up the virtual filesystem and load the game data the same way the game
+ * itself does, minus the terminal.
+ * ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****/
+bool headlessStartup(const char *argv0) {
+    PHYSFS_init(argv0);
+    const char *writeDir = PHYSFS_getPrefDir("grendrake", "morphrl");
+    if (!writeDir || PHYSFS_setWriteDir(writeDir) == 0) {
+        std::cerr << "failed to set write directory: ";
+        std::cerr << PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()) << ".\n";
+        return false;
+    }
+    PHYSFS_mount(writeDir, "/saves", 1);
+    PHYSFS_mount(PHYSFS_getBaseDir(), "/root", 1);
+    loadConfigData("game.cfg");
+    PHYSFS_mount("resources", "/", 1);
+    PHYSFS_mount("gamedata.dat", "/", 1);
+    if (!loadAllData()) {
+        std::cerr << "Failed to load game data; see game.log for details.\n";
+        return false;
+    }
+    return true;
+}
@@ -65,9 +65,9 @@ void debug_saveMapToPNG(const Dungeon &d, bool showActors) {
     for (int y = 0; y < d.height(); ++y) {
         for (int x = 0; x < d.width(); ++x, ++pos) {
             unsigned pos = datapos(x,y,d.width());
-            const MapTile *tile = d.at(Coord(x, y));
-            if (showActors && tile->actor) {
-                if (tile->actor->data.ident == 0) {
+            const Actor *actor = d.actorAt(Coord(x, y));
+            if (showActors && actor) {
+                if (actor->data.ident == 0) {
                     mapdata[pos  ] = 127;
                     mapdata[pos+1] = 255;
                     mapdata[pos+2] = 127;
@@ -77,7 +77,7 @@ void debug_saveMapToPNG(const Dungeon &d, bool showActors) {
                     mapdata[pos+2] = 127;
                 }
             } else {
-                const TileData &td = getTileData(tile->floor);
+                const TileData &td = getTileData(d.floorAt(Coord(x, y)));
                 mapdata[pos  ] = td.r;
                 mapdata[pos+1] = td.g;
                 mapdata[pos+2] = td.b;
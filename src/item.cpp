@@ -1,11 +1,11 @@
 
 #include "morph.h"
 
-Item::Item(const ItemData &data)
+Item::Item(const ItemData &data, RNG &rng)
 : data(data), position(-1, -1), isEquipped(false), chargesLeft(0)
 {
     if (data.maxCharges > 0) {
-        chargesLeft = globalRNG.upto(data.maxCharges);
+        chargesLeft = rng.upto(data.maxCharges);
         if (chargesLeft <= 0) chargesLeft = 1;
     }
 }
@@ -43,7 +43,7 @@ void activateItem(World &world, Item *item, Actor *user) {
 
     for (const EffectData &data : item->data.effects) {
         if (data.trigger != ET_ON_USE) continue;
-        std::string result = triggerEffect(data, user, nullptr);
+        std::string result = triggerEffect(data, user, nullptr, world.combatRNG);
         if (!result.empty()) {
             msg += result;
             didEffect = true;
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <string>
@@ -6,34 +7,6 @@
 #include "morph.h"
 
 
-    // MapgenArgs mapgenArgs{
-        // 255,    // width
-        // 255,    // height
-        // 10000,  // roomAttempts
-        // 25,     // trim dead end iterations
-        // 10,     // roomFillChance
-        // 40,     // roomSecondDoorChance
-        // 30,     // deadEndFillChance
-        // 40,     // deadEndDoorChance
-        // 10,     // roomMaxWidth
-        // 10,     // roomMaxHeight
-        // 20,      // mazeDoorChance
-        // 600,    // maxActorCount
-        // 1600,   // maxItemCount
-
-// for 63x63
-const int ROOM_ATTEMPTS = 10000;
-const int TRIM_DEADEND_ITERATIONS = 25;
-const int ROOM_FILL_CHANCE = 10;
-const int ROOM_SECOND_DOOR_CHANCE = 40;
-const int DEADEND_FILL_CHANCE = 70;
-const int DEADEND_DOOR_CHANCE = 15;
-const int ROOM_MAX_WIDTH = 10;
-const int ROOM_MAX_HEIGHT = 10;
-const int MAZE_DOOR_CHANCE = 20;
-const int ADD_EXTRA_DOOR_COUNT = 5;
-
-
 bool isOdd(int number) {
     return number % 2;
 }
@@ -42,12 +15,19 @@ bool isOdd(const Coord &c) {
 }
 
 
-void buildMaze(Dungeon &d) {
+void buildMaze(Dungeon &d, RNG &rng) {
     Coord initial;
+    int iterations = 1000;
     do {
-        initial = d.randomOfTile(TILE_UNASSIGNED);
-    } while (!isOdd(initial));
-    d.at(initial)->floor = TILE_FLOOR;
+        initial = d.randomOfTile(rng, TILE_UNASSIGNED);
+        --iterations;
+    } while (iterations > 0 && !isOdd(initial));
+    if (!isOdd(initial)) {
+        // the rooms have left no space for a maze
+        d.replaceTile(TILE_UNASSIGNED, TILE_WALL);
+        return;
+    }
+    d.floorAt(initial, TILE_FLOOR);
 
     std::vector<Coord> steps;
     steps.push_back(initial);
@@ -63,26 +43,25 @@ void buildMaze(Dungeon &d) {
         // already got a passage in that direction, rotate direction and try
         // again. if no direction succeeds, remove this point from the list and
         // stop trying
-        Direction dir = randomCardinalDirection();
+        Direction dir = randomCardinalDirection(rng);
         Direction wd = dir;
         bool success;
         do {
             success = false;
             Coord target = here.shift(wd, 2);
-            MapTile *tile = d.at(target);
-            if (!tile || tile->floor != TILE_UNASSIGNED) {
+            if (!d.isValidPosition(target) || d.floorAt(target) != TILE_UNASSIGNED) {
                 // cant go this way
                 wd = rotate90(wd);
                 continue;
             }
             // we found a valid direction; build tunnel and add new point to list
-            tile->floor = TILE_FLOOR;
-            tile = d.at(here.shift(wd));
-            if (tile) {
-                if (globalRNG.upto(1000) < MAZE_DOOR_CHANCE) {
-                    tile->floor = TILE_CLOSED_DOOR;
+            d.floorAt(target, TILE_FLOOR);
+            Coord between = here.shift(wd);
+            if (d.isValidPosition(between)) {
+                if (rng.upto(1000) < d.data.mapgen.mazeDoorChance) {
+                    d.floorAt(between, TILE_CLOSED_DOOR);
                 } else {
-                    tile->floor = TILE_FLOOR;
+                    d.floorAt(between, TILE_FLOOR);
                 }
             }
             steps.push_back(target);
@@ -106,36 +85,112 @@ void createRoom(Dungeon &d, const Room &room) {
 }
 
 
-void buildRooms(Dungeon &d) {
-    int xRange = ROOM_MAX_WIDTH - 2;
-    int yRange = ROOM_MAX_HEIGHT - 2;
+// The 3x3 squares at even positions that are still entirely unassigned. Every
+// room buildRooms places has an even position and odd dimensions, so it's made
+// up of these squares overlapping by a tile and fits wherever all the squares
+// it covers are free. Placing a room only touches the squares around it, which
+// keeps the cost of each room independent of the size of the level.
+class RoomSlotGrid {
+public:
+    RoomSlotGrid(const Dungeon &d)
+    : mSlotsWide(d.width() >= 3 ? (d.width() - 3) / 2 + 1 : 0),
+      mSlotsHigh(d.height() >= 3 ? (d.height() - 3) / 2 + 1 : 0),
+      mWidth(d.width()), mHeight(d.height()),
+      mFree(mSlotsWide * mSlotsHigh, 0), mFreeCount(0)
+    {
+        for (int sy = 0; sy < mSlotsHigh; ++sy) {
+            for (int sx = 0; sx < mSlotsWide; ++sx) {
+                if (d.areaIsTile(sx * 2, sy * 2, 3, 3, TILE_UNASSIGNED)) {
+                    mFree[sy * mSlotsWide + sx] = 1;
+                    ++mFreeCount;
+                }
+            }
+        }
+    }
 
-    for (int i = 0; i < ROOM_ATTEMPTS; ++i) {
-        int x = 1 + globalRNG.upto(d.width() - 2);
-        x = x / 2 * 2;
-        int y = 1 + globalRNG.upto(d.height() - 2);
-        y = y / 2 * 2;
-        int w = 3 + globalRNG.upto(xRange);
-        w = w / 2 * 2 + 1;
-        int h = 3 + globalRNG.upto(yRange);
-        h = h / 2 * 2 + 1;
+    // true if a room with this (even) position and (odd) size lies within the
+    // map and every tile in it is unassigned
+    bool isFree(int x, int y, int w, int h) const {
+        if (x < 0 || y < 0 || x + w > mWidth || y + h > mHeight) return false;
+        for (int sy = y / 2; sy * 2 + 3 <= y + h; ++sy) {
+            for (int sx = x / 2; sx * 2 + 3 <= x + w; ++sx) {
+                if (!mFree[sy * mSlotsWide + sx]) return false;
+            }
+        }
+        return true;
+    }
 
-        if (d.areaIsTile(x, y, w, h, 0)) {
-            createRoom(d, Room{RT_GENERIC, x, y, w, h, Direction::Unknown});
+    // mark every square that overlaps the rectangle as used
+    void markUsed(int x, int y, int w, int h) {
+        int firstX = std::max(0, (x - 1) / 2), lastX = std::min(mSlotsWide - 1, (x + w - 1) / 2);
+        int firstY = std::max(0, (y - 1) / 2), lastY = std::min(mSlotsHigh - 1, (y + h - 1) / 2);
+        for (int sy = firstY; sy <= lastY; ++sy) {
+            for (int sx = firstX; sx <= lastX; ++sx) {
+                uint8_t &slot = mFree[sy * mSlotsWide + sx];
+                if (slot) --mFreeCount;
+                slot = 0;
+            }
+        }
+    }
+
+    // true if there's anywhere left that buildRooms could put a room
+    bool anyFree() const {
+        return mFreeCount > 0;
+    }
+
+private:
+    int mSlotsWide, mSlotsHigh;
+    int mWidth, mHeight;
+    std::vector<uint8_t> mFree;
+    int mFreeCount;
+};
+
+void buildRooms(Dungeon &d, RNG &rng) {
+    const MapgenArgs &args = d.data.mapgen;
+    int xRange = args.roomMaxWidth - 2;
+    int yRange = args.roomMaxHeight - 2;
+
+    // the positions and sizes are drawn a batch of attempts at a time
+    const int batchSize = 256;
+    int xRolls[batchSize], yRolls[batchSize], wRolls[batchSize], hRolls[batchSize];
+    RoomSlotGrid freeSpace(d);
+    bool roomsFit = freeSpace.anyFree();
+    for (int first = 0; roomsFit && first < args.roomAttempts; first += batchSize) {
+        int count = std::min(batchSize, args.roomAttempts - first);
+        rng.fill(xRolls, count, d.width() - 2);
+        rng.fill(yRolls, count, d.height() - 2);
+        rng.fill(wRolls, count, xRange);
+        rng.fill(hRolls, count, yRange);
+        for (int i = 0; roomsFit && i < count; ++i) {
+            int x = 1 + xRolls[i];
+            x = x / 2 * 2;
+            int y = 1 + yRolls[i];
+            y = y / 2 * 2;
+            int w = 3 + wRolls[i];
+            w = w / 2 * 2 + 1;
+            int h = 3 + hRolls[i];
+            h = h / 2 * 2 + 1;
+
+            if (freeSpace.isFree(x, y, w, h)) {
+                createRoom(d, Room{RT_GENERIC, x, y, w, h, Direction::Unknown});
+                freeSpace.markUsed(x, y, w, h);
+                // stop once even the smallest room has nowhere to go
+                roomsFit = freeSpace.anyFree();
+            }
         }
     }
 }
 
 
-void addDoorToRoom(Dungeon &d, Room &room) {
+void addDoorToRoom(Dungeon &d, Room &room, RNG &rng) {
     bool isValid;
     int iterations = 10;
     do {
         --iterations;
         isValid = false;
-        Coord p = room.getPointWithin();
+        Coord p = room.getPointWithin(rng);
         // d.at(p)->floor = 3;
-        Direction dir = randomCardinalDirection();
+        Direction dir = randomCardinalDirection(rng);
         if (dir == room.roomDirection) continue;
         while (d.isValidPosition(p) && d.floorAt(p) != TILE_WALL) {
             p = p.shift(dir);
@@ -150,6 +205,7 @@ void addDoorToRoom(Dungeon &d, Room &room) {
         // we can't find a valid door placement, so fill the room instead
         d.fillRect(room.x, room.y, room.w, room.h, 1);
         room.isFilled = true;
+        ++d.mapgenStats.doorFailures;
         std::string errorMessage = "(failed to place door for room at ";
         errorMessage += std::to_string(room.x) + "," + std::to_string(room.y) + ")";
         logMessage(LOG_WARN, errorMessage);
@@ -157,43 +213,42 @@ void addDoorToRoom(Dungeon &d, Room &room) {
 }
 
 
-void setupRooms(Dungeon &d) {
+void setupRooms(Dungeon &d, RNG &rng) {
     for (int i = 0; i < d.roomCount(); ++i) {
         Room &room = d.getRoom(i);
         if (room.w < 1) continue; // invalid room
-        if (room.type == RT_GENERIC && (room.area() <= 3 || (globalRNG.upto(100)) < ROOM_FILL_CHANCE)) {
+        if (room.type == RT_GENERIC && (room.area() <= 3 || (rng.upto(100)) < d.data.mapgen.roomFillChance)) {
             // filled in room
             d.fillRect(room.x, room.y, room.w, room.h, 1);
             room.isFilled = true;
         } else {
-            addDoorToRoom(d, room);
-            if (room.type == RT_ENTRANCE || globalRNG.upto(100) < ROOM_SECOND_DOOR_CHANCE) {
-                addDoorToRoom(d, room);
+            addDoorToRoom(d, room, rng);
+            if (room.type == RT_ENTRANCE || rng.upto(100) < d.data.mapgen.roomSecondDoorChance) {
+                addDoorToRoom(d, room, rng);
             }
         }
 
         if (room.type == RT_ENTRANCE) {
             for (int y = 0; y < room.h; ++y) {
                 for (int x = 0; x < room.w; ++x) {
-                    MapTile *tile = d.at(Coord(x + room.x, y + room.y));
-                    if (tile) {
-                        tile->temperature = 0;
-                        if (tile->floor == TILE_FLOOR) tile->floor = TILE_GRASS;
-                    }
+                    Coord here(x + room.x, y + room.y);
+                    d.temperatureAt(here, 0);
+                    if (d.floorAt(here) == TILE_FLOOR) d.floorAt(here, TILE_GRASS);
                 }
             }
         }
     }
 }
 
-void trimDeadEnds(Dungeon &d) {
+void trimDeadEnds(Dungeon &d, RNG &rng) {
+    const MapgenArgs &args = d.data.mapgen;
     for (int y = 1; y < d.height(); y += 2) {
         for (int x = 1; x < d.width(); x += 2) {
             Coord here(x, y);
             if (d.floorAt(here) != TILE_FLOOR) continue;
             int wallCount = 0;
             Direction dir = Direction::North;
-            Direction opening;
+            Direction opening = Direction::Unknown;
             do {
                 Coord dest = here.shift(dir);
                 if (d.floorAt(dest) == TILE_WALL) ++wallCount;
@@ -201,14 +256,14 @@ void trimDeadEnds(Dungeon &d) {
                 dir = rotate90(dir);
             } while (dir != Direction::North);
             if (wallCount == 3) {
-                int roll = globalRNG.upto(100);
-                if (roll < DEADEND_FILL_CHANCE) {
+                int roll = rng.upto(100);
+                if (roll < args.deadEndFillChance) {
                     // fill in dead end
                     d.floorAt(here, TILE_WALL);
                     d.floorAt(here.shift(opening), TILE_WALL);
-                } else if (roll < (DEADEND_FILL_CHANCE + DEADEND_DOOR_CHANCE)) {
+                } else if (roll < (args.deadEndFillChance + args.deadEndDoorChance)) {
                     // add door to neighboring space
-                    Direction dir = randomCardinalDirection();
+                    Direction dir = randomCardinalDirection(rng);
                     Direction workdir = dir;
                     do {
                         if (workdir != opening && d.floorAt(here.shift(workdir, 2)) == TILE_FLOOR) {
@@ -238,30 +293,46 @@ Direction getDeadEndOpening(Dungeon &d, const Coord &where) {
     return Direction::Unknown;
 }
 
+// Fills in every dead end in the maze, following each one back along its
+// passage for as long as filling it leaves another dead end behind. Each fill
+// walls off two cells, so the work is bounded by the size of the maze.
 void removeDeadEnds(Dungeon &d) {
+    std::vector<Coord> worklist;
+    BitPlane queued(d.width() * d.height());
     for (int y = 1; y < d.height(); y += 2) {
         for (int x = 1; x < d.width(); x += 2) {
             Coord here(x, y);
-            Direction opening;
-            int iterations = 50;
-            do {
-                --iterations;
-                opening = getDeadEndOpening(d, here);
-                if (opening != Direction::Unknown) {
-                    d.floorAt(here, TILE_WALL);
-                    d.floorAt(here.shift(opening), TILE_WALL);
-                }
-                here = here.shift(opening, 2);
-            } while (iterations > 0 && opening != Direction::Unknown);
+            if (getDeadEndOpening(d, here) != Direction::Unknown) {
+                worklist.push_back(here);
+                queued.set(d.toPosition(here));
+            }
+        }
+    }
+    // popped from the back, so reverse to visit in the order found
+    std::reverse(worklist.begin(), worklist.end());
+
+    while (!worklist.empty()) {
+        Coord here = worklist.back();
+        worklist.pop_back();
+        queued.reset(d.toPosition(here));
+        Direction opening = getDeadEndOpening(d, here);
+        if (opening == Direction::Unknown) continue;
+        d.floorAt(here, TILE_WALL);
+        d.floorAt(here.shift(opening), TILE_WALL);
+        Coord beyond = here.shift(opening, 2);
+        if (d.isValidPosition(beyond) && !queued.test(d.toPosition(beyond))
+                && getDeadEndOpening(d, beyond) != Direction::Unknown) {
+            queued.set(d.toPosition(beyond));
+            worklist.push_back(beyond);
         }
     }
 }
 
-void createLake(Dungeon &d) {
-    int x = 1 + globalRNG.upto(d.width() - 2);
-    int y = 1 + globalRNG.upto(d.height() - 2);
+void createLake(Dungeon &d, RNG &rng) {
+    int x = 1 + rng.upto(d.width() - 2);
+    int y = 1 + rng.upto(d.height() - 2);
     Coord root(x, y);
-    int r = 3 + globalRNG.upto(4);
+    int r = 3 + rng.upto(4);
     for (int wy = y - r; wy <= y + r; ++wy) {
         for (int wx = x - r; wx <= x + r; ++wx) {
             Coord here(wx, wy);
@@ -272,18 +343,17 @@ void createLake(Dungeon &d) {
     }
 };
 
-void createTemperatureZone(Dungeon &d, int forTemp) {
-    int x = 1 + globalRNG.upto(d.width() - 2);
-    int y = 1 + globalRNG.upto(d.height() - 2);
+void createTemperatureZone(Dungeon &d, RNG &rng, int forTemp) {
+    int x = 1 + rng.upto(d.width() - 2);
+    int y = 1 + rng.upto(d.height() - 2);
     Coord root(x, y);
-    int r = 3 + globalRNG.upto(10);
+    int r = 3 + rng.upto(10);
     for (int wy = y - r; wy <= y + r; ++wy) {
         for (int wx = x - r; wx <= x + r; ++wx) {
             Coord here(wx, wy);
             double dist = root.distanceTo(here);
             if (dist > r) continue;
-            MapTile *tile = d.at(here);
-            if (tile) tile->temperature = forTemp;
+            d.temperatureAt(here, forTemp);
         }
     }
 };
@@ -327,12 +397,12 @@ void addStairs(Dungeon &d) {
     }
 }
 
-void addEntranceHall(Dungeon &d) {
+void addEntranceHall(Dungeon &d, RNG &rng) {
     Room room{RT_ENTRANCE};
-    Coord pos(MAP_WIDTH / 2, MAP_HEIGHT / 2);
+    Coord pos(d.width() / 2, d.height() / 2);
     if (!isOdd(pos.x)) --pos.x;
     if (!isOdd(pos.y)) --pos.y;
-    room.roomDirection = randomCardinalDirection();
+    room.roomDirection = randomCardinalDirection(rng);
     while (d.isValidPosition(pos.shift(room.roomDirection))) {
         pos = pos.shift(room.roomDirection);
     }
@@ -345,14 +415,14 @@ void addEntranceHall(Dungeon &d) {
     createRoom(d, room);
 }
 
-void addExtraDoors(Dungeon &d) {
+void addExtraDoors(Dungeon &d, RNG &rng) {
     Coord where;
     bool isGood = false;
     int iterations = 10;
     do {
         --iterations;
-        where.x = 2 + globalRNG.upto(d.width() - 2);
-        where.y = 2 + globalRNG.upto(d.height() - 2);
+        where.x = 2 + rng.upto(d.width() - 2);
+        where.y = 2 + rng.upto(d.height() - 2);
         isGood = d.floorAt(where) == TILE_WALL;
         if (!isGood) continue;
         if (d.floorAt(where.shift(Direction::North)) == TILE_WALL) {
@@ -372,10 +442,10 @@ void addExtraDoors(Dungeon &d) {
 }
 
 const ActorData INVALID_SPAWN { BAD_VALUE };
-const ActorData& pickActorFromSpawnLine(const std::vector<SpawnLine> &lines, bool forRefresh) {
+const ActorData& pickActorFromSpawnLine(const std::vector<SpawnLine> &lines, RNG &rng, bool forRefresh) {
     int iterations = 25;
     do {
-        int roll = globalRNG.upto(100);
+        int roll = rng.upto(100);
         for (const SpawnLine &line : lines) {
             if (roll < line.spawnChance) {
                 const ActorData& data = getActorData(line.ident);
@@ -390,7 +460,7 @@ const ActorData& pickActorFromSpawnLine(const std::vector<SpawnLine> &lines, boo
     return INVALID_SPAWN;
 }
 
-void spawnActors(Dungeon &d, bool forRefresh) {
+void spawnActors(Dungeon &d, RNG &rng, bool forRefresh) {
     unsigned targetCount = d.data.actorCount;
     if (forRefresh) targetCount = targetCount / 4;
     unsigned initialSpeedCounter = d.getHighestSpeedCounter();
@@ -403,18 +473,23 @@ void spawnActors(Dungeon &d, bool forRefresh) {
             --iterations;
             isGood = false;
             if (iterations <= 0) break;
-            c = d.randomOfTile(TILE_FLOOR);
+            c = d.randomOfTile(rng, TILE_FLOOR);
+            // a level with no floor has nowhere to put anything
+            if (c.x < 0) break;
             if (d.actorAt(c) != nullptr) continue;
             if (forRefresh && d.isSeen(c)) continue;
             const Room &inRoom = d.getRoom(c);
             if (inRoom.type == RT_STAIR) continue;
             isGood = true;
         } while (!isGood && iterations > 0);
-        if (!isGood) continue;
+        if (!isGood) {
+            ++d.mapgenStats.actorFailures;
+            continue;
+        }
 
-        const ActorData &actorData = pickActorFromSpawnLine(d.data.actorSpawns, forRefresh);
+        const ActorData &actorData = pickActorFromSpawnLine(d.data.actorSpawns, rng, forRefresh);
         if (actorData.ident != BAD_VALUE) {
-            Actor *actor = Actor::create(getActorData(actorData.ident));
+            Actor *actor = Actor::create(getActorData(actorData.ident), rng);
             if (actor) {
                 actor->reset();
                 actor->speedCounter = initialSpeedCounter + 1;
@@ -424,23 +499,27 @@ void spawnActors(Dungeon &d, bool forRefresh) {
     }
 }
 
-void spawnItems(Dungeon &d) {
+void spawnItems(Dungeon &d, RNG &rng) {
     for (unsigned i = 0; i < d.data.itemCount; ++i) {
         bool isGood = false;
         int iterations = 20;
         Coord c;
         do {
             if (iterations <= 0) break;
-            c = d.randomOfTile(TILE_FLOOR);
+            c = d.randomOfTile(rng, TILE_FLOOR);
+            if (c.x < 0) break;
             isGood = d.itemAt(c) == nullptr;
             --iterations;
         } while (!isGood && iterations > 0);
-        if (!isGood) continue;
+        if (!isGood) {
+            ++d.mapgenStats.itemFailures;
+            continue;
+        }
 
-        int roll = globalRNG.upto(100);
+        int roll = rng.upto(100);
         for (const SpawnLine &line : d.data.itemSpawns) {
             if (roll < line.spawnChance) {
-                Item *item = new Item(getItemData(line.ident));
+                Item *item = new Item(getItemData(line.ident), rng);
                 if (item) {
                     d.addItem(item, c);
                 }
@@ -451,26 +530,26 @@ void spawnItems(Dungeon &d) {
     }
 }
 
-void doMapgen(Dungeon &d) {
+void doMapgen(Dungeon &d, RNG &rng) {
     logMessage(LOG_INFO, "MAPGEN for " + std::to_string(d.depth()));
     // if we're on the ground floor, create the entrance room
-    // if (d.data.hasEntrance) addEntranceHall(d);
-    buildRooms(d);
+    // if (d.data.hasEntrance) addEntranceHall(d, rng);
+    buildRooms(d, rng);
     addStairs(d);
-    buildMaze(d);
-    // createTemperatureZone(d, -1);
-    // createTemperatureZone(d, 1);
-    setupRooms(d);
+    buildMaze(d, rng);
+    // createTemperatureZone(d, rng, -1);
+    // createTemperatureZone(d, rng, 1);
+    setupRooms(d, rng);
     removeDeadEnds(d);
-    // for (int i = 0; i < TRIM_DEADEND_ITERATIONS; ++i) {
-        // trimDeadEnds(d);
-    // }
-    for (int i = 0; i < ADD_EXTRA_DOOR_COUNT; ++i) {
-        addExtraDoors(d);
+    for (int i = 0; i < d.data.mapgen.deadEndTrimPasses; ++i) {
+        trimDeadEnds(d, rng);
+    }
+    for (int i = 0; i < d.data.mapgen.extraDoorCount; ++i) {
+        addExtraDoors(d, rng);
     }
     // for (int i = 0; i < 50; ++i) {
-        // createLake(d);
+        // createLake(d, rng);
     // }
-    spawnActors(d, false);
-    spawnItems(d);
+    spawnActors(d, rng, false);
+    spawnItems(d, rng);
 }
@@ -1,8 +1,13 @@
 #ifndef MORPH_H
 #define MORPH_H
 
+#include <algorithm>
+#include <cstdint>
+#include <future>
 #include <iosfwd>
+#include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "random.h"
@@ -10,6 +15,7 @@
 class Actor;
 class Dungeon;
 class Item;
+class SaveFile;
 class World;
 
 
@@ -20,8 +26,11 @@ const int LOG_WARN = 1;
 const int LOG_ERROR = 2;
 const int LOG_DEBUG = 3;
 
+// the size of a level that doesn't give one in levels.dat
 const int MAP_WIDTH = 63;
 const int MAP_HEIGHT = 47;
+const int MIN_MAP_SIZE = 15;
+const int MAX_MAP_SIZE = 4096;
 const int MAX_TALISMANS_WORN = 3;
 
 const int DE_ENTRANCE = 0;
@@ -43,6 +52,10 @@ const int TILE_STAIR_UP = 7;
 const int TILE_GRASS = 8;
 const int TILE_OPEN_DOOR = 9;
 const int TILE_NOTHING = 10;
+const int MAX_TILE_IDENT = 255;
+
+const unsigned TF_PASSABLE = 0x01;
+const unsigned TF_OPAQUE = 0x02;
 
 const int AR_NONE = 0;
 const int AR_TARGET = 1;
@@ -143,6 +156,10 @@ enum class Direction {
     North, Northeast, East, Southeast, South, Southwest, West, Northwest,
 };
 
+Direction rotate45(Direction d);
+Direction unrotate45(Direction d);
+Direction rotate90(Direction d);
+
 enum class GameReturn {
     Normal,
     FullQuit
@@ -312,6 +329,21 @@ struct TileData {
     bool isDownStair;
 };
 
+// The settings used when generating a level, given by the mapgen properties of
+// its @dungeon entry. Chances are percentages except where noted.
+struct MapgenArgs {
+    int width, height;
+    int roomAttempts;
+    int roomFillChance;
+    int roomSecondDoorChance;
+    int roomMaxWidth, roomMaxHeight;
+    int mazeDoorChance; // per thousand
+    int deadEndTrimPasses;
+    int deadEndFillChance;
+    int deadEndDoorChance;
+    int extraDoorCount;
+};
+
 struct DungeonData {
     unsigned ident; // doubles as dungeon depth
     std::string name;
@@ -323,6 +355,7 @@ struct DungeonData {
     Coord initialPosition;
     std::vector<SpawnLine> actorSpawns;
     std::vector<SpawnLine> itemSpawns;
+    MapgenArgs mapgen;
 };
 
 
@@ -353,7 +386,7 @@ struct MutationItem {
 };
 
 struct Actor {
-    static Actor* create(const ActorData &data);
+    static Actor* create(const ActorData &data, RNG &rng);
     ~Actor();
 
     bool isDead() const { return health <= 0; }
@@ -367,6 +400,9 @@ struct Actor {
     int getStatItemBonus(int statNumber) const;
     int getStatBase(int statNumber) const;
     int getStat(int statNumber) const;
+    // must be called after changing anything getStat depends on (items or
+    // their equipped state, status effects, mutations, or stat levels)
+    void invalidateStats();
     // AttackResult makeAttack(Actor *target);
     void takeDamage(int amount, Actor *fromWho);
     void spendEnergy(int amount);
@@ -381,9 +417,9 @@ struct Actor {
     bool hasVictoryArtifact() const;
     bool isArmed() const;
     const Item* getCurrentWeapon() const;
-    std::string triggerOnHitEffects(Actor *target, const Item *weapon);
-    AttackData meleeAttackWithWeapon(Actor *target, const Item *weapon);
-    AttackData meleeAttack(Actor *target);
+    std::string triggerOnHitEffects(Actor *target, const Item *weapon, RNG &rng);
+    AttackData meleeAttackWithWeapon(Actor *target, const Item *weapon, RNG &rng);
+    AttackData meleeAttack(Actor *target, RNG &rng);
     void advanceSpeedCounter(int multiplier = 100);
     MutationItem* mutationForSlot(unsigned slotNumber);
     bool hasMutation(unsigned mutationIdent) const;
@@ -402,6 +438,9 @@ struct Actor {
     int xp, advancementPoints;
     Coord playerLastSeenPosition;
     unsigned speedCounter;
+    // position in, and order of arrival to, the current level's schedule
+    int scheduleSlot;
+    unsigned scheduleOrder;
 
     int health, energy;
     std::vector<Item*> inventory;
@@ -411,11 +450,16 @@ struct Actor {
     unsigned turnsSinceCombatAction;
 
 private:
+    friend class SaveFile;
     Actor(const ActorData &data, unsigned myIdent);
+    int calcStat(int statNumber) const;
+
+    mutable int mStatCache[STAT_ALL_COUNT];
+    mutable bool mStatCacheValid;
 };
 
 struct Item {
-    Item(const ItemData &data);
+    Item(const ItemData &data, RNG &rng);
 
     std::string getName(bool definitive = false) const;
     int getStatBonus(int statNumber, bool isArmed) const;
@@ -426,14 +470,207 @@ struct Item {
     int chargesLeft;
 };
 
-struct MapTile {
-    MapTile();
-    int floor;
-    Actor *actor;
-    std::vector<Item*> items;
-    int temperature;
-    bool isSeen, everSeen, inFovCalc;
-    int distanceValue;
+// A fixed-size set of bits packed 64 to a word, used for the per-tile flags on
+// a Dungeon so that clearing, merging, and scanning them works a word at a time.
+class BitPlane {
+public:
+    // Visits the index of each set bit in ascending order.
+    class iterator {
+    public:
+        iterator(const uint64_t *words, unsigned wordCount, unsigned wordIndex);
+        unsigned operator*() const { return (mWordIndex << 6) + __builtin_ctzll(mWord); }
+        iterator& operator++();
+        bool operator!=(const iterator &rhs) const { return mWordIndex != rhs.mWordIndex || mWord != rhs.mWord; }
+    private:
+        void skipEmptyWords();
+        const uint64_t *mWords;
+        unsigned mWordCount, mWordIndex;
+        uint64_t mWord;
+    };
+
+    // The set bits of part of the plane, for walking it with a range for.
+    class Span {
+    public:
+        Span(iterator first, iterator last) : mBegin(first), mEnd(last) { }
+        iterator begin() const { return mBegin; }
+        iterator end() const { return mEnd; }
+    private:
+        iterator mBegin, mEnd;
+    };
+
+    BitPlane() : mSize(0) { }
+    explicit BitPlane(unsigned size);
+
+    unsigned size() const { return mSize; }
+    void resize(unsigned size);
+    bool test(unsigned index) const { return (mWords[index >> 6] >> (index & 63)) & 1; }
+    void set(unsigned index) { mWords[index >> 6] |= uint64_t(1) << (index & 63); }
+    void reset(unsigned index) { mWords[index >> 6] &= ~(uint64_t(1) << (index & 63)); }
+    void set(unsigned index, bool value) { if (value) set(index); else reset(index); }
+
+    void clear();
+    // clears the bits with indexes from first up to but not including last
+    void clear(unsigned first, unsigned last);
+    // sets the bits with indexes from first up to but not including last
+    void fill(unsigned first, unsigned last);
+    // count (at most 64) bits starting from first, with first in the lowest bit
+    uint64_t bits(unsigned first, unsigned count) const {
+        unsigned word = first >> 6, shift = first & 63;
+        uint64_t result = mWords[word] >> shift;
+        // the run carries on into the next word
+        if (shift + count > 64) result |= mWords[word + 1] << (64 - shift);
+        return count < 64 ? result & ((uint64_t(1) << count) - 1) : result;
+    }
+    void merge(const BitPlane &other);
+    unsigned count() const;
+    bool any() const;
+
+    iterator begin() const { return iterator(mWords.data(), mWords.size(), 0); }
+    iterator end() const { return iterator(mWords.data(), mWords.size(), mWords.size()); }
+    // the set bits with indexes from first up to but not including last; the
+    // words containing either end are visited whole
+    Span span(unsigned first, unsigned last) const;
+private:
+    unsigned mSize;
+    std::vector<uint64_t> mWords;
+};
+
+
+// Orders the actors on a level by when they next act: the lowest speedCounter
+// goes first, with ties going to whichever actor arrived on the level first.
+// The actors are kept in a binary heap and each remembers its slot within it,
+// so an actor whose speedCounter changes can be repositioned on its own.
+class ActorScheduler {
+public:
+    ActorScheduler() : mNextOrder(0) { }
+
+    void add(Actor *actor);
+    void remove(Actor *actor);
+    void update(Actor *actor);
+    void rebuild();
+    Actor* next();
+private:
+    bool before(const Actor *lhs, const Actor *rhs) const;
+    void place(unsigned slot, Actor *actor);
+    void siftUp(unsigned slot);
+    void siftDown(unsigned slot);
+    void removeAt(unsigned slot);
+
+    unsigned mNextOrder;
+    std::vector<Actor*> mHeap;
+    // dead actors skipped over by next(); they return to the heap if they
+    // recover before the level clears them away
+    std::vector<Actor*> mSetAside;
+};
+
+
+// Step counts from one or more sources across the tiles of a level that can be
+// walked through, with diagonal steps counting the same as any other. Tiles
+// that can't be reached read as -1. The counts are kept in 16 bits, so on the
+// largest levels the furthest tiles all read as the maximum.
+class DistanceMap {
+public:
+    DistanceMap() : mWidth(0), mHeight(0) { }
+
+    void resize(int width, int height);
+    void clear();
+    int at(const Coord &where) const;
+
+    // canEnter(position) says whether a tile can be stepped onto; the sources
+    // are always counted as reached
+    template<class CanEnter>
+    void calculate(const std::vector<Coord> &sources, CanEnter canEnter);
+
+    // the neighbouring tile of where that is closest to the sources and
+    // isn't blocked, trying the preferred direction first among equals;
+    // Unknown if no neighbour is any closer
+    template<class IsBlocked>
+    Direction stepToward(const Coord &where, Direction preferred, IsBlocked isBlocked) const;
+
+private:
+    bool isValid(int x, int y) const { return x >= 0 && y >= 0 && x < mWidth && y < mHeight; }
+
+    int mWidth, mHeight;
+    std::vector<int16_t> mDistance;
+    // every tile is queued at most once, so a queue the size of the level
+    // never needs to wrap around
+    std::vector<unsigned> mQueue;
+};
+
+template<class CanEnter>
+void DistanceMap::calculate(const std::vector<Coord> &sources, CanEnter canEnter) {
+    static const int stepX[8] = {  0,  1, 1, 1, 0, -1, -1, -1 };
+    static const int stepY[8] = { -1, -1, 0, 1, 1,  1,  0, -1 };
+    clear();
+    unsigned head = 0, tail = 0;
+    for (const Coord &source : sources) {
+        if (!isValid(source.x, source.y)) continue;
+        unsigned pos = source.x + source.y * mWidth;
+        if (mDistance[pos] >= 0) continue;
+        mDistance[pos] = 0;
+        mQueue[tail++] = pos;
+    }
+
+    while (head < tail) {
+        const unsigned work = mQueue[head++];
+        const int x = work % mWidth, y = work / mWidth;
+        const int nextDistance = std::min(mDistance[work] + 1, INT16_MAX);
+        for (int i = 0; i < 8; ++i) {
+            int adjX = x + stepX[i], adjY = y + stepY[i];
+            if (!isValid(adjX, adjY)) continue;
+            unsigned adjPos = adjX + adjY * mWidth;
+            if (mDistance[adjPos] >= 0 || !canEnter(adjPos)) continue;
+            mDistance[adjPos] = nextDistance;
+            mQueue[tail++] = adjPos;
+        }
+    }
+}
+
+template<class IsBlocked>
+Direction DistanceMap::stepToward(const Coord &where, Direction preferred, IsBlocked isBlocked) const {
+    int bestDistance = at(where);
+    if (bestDistance <= 0) return Direction::Unknown;
+    Direction best = Direction::Unknown;
+    if (preferred == Direction::Unknown || preferred == Direction::Here) preferred = Direction::North;
+    Direction dir = preferred;
+    do {
+        Coord dest = where.shift(dir);
+        int distance = at(dest);
+        if (distance >= 0 && distance < bestDistance && !isBlocked(dest)) {
+            best = dir;
+            bestDistance = distance;
+        }
+        dir = rotate45(dir);
+    } while (dir != preferred);
+    return best;
+}
+
+// The tiles covered by an ability, in the order they were found, along with
+// a mask of the same tiles so that checking whether a tile is covered doesn't
+// mean searching the list. Meant to be kept and refilled; once it has grown to
+// fit a level, refilling it doesn't allocate.
+class EffectArea {
+public:
+    EffectArea() : mWidth(0), mHeight(0) { }
+
+    // empties the area and sizes the mask for a level
+    void reset(int width, int height);
+    // adds a tile on the level; tiles already in the area are ignored
+    void add(const Coord &where);
+    bool contains(const Coord &where) const {
+        if (where.x < 0 || where.y < 0 || where.x >= mWidth || where.y >= mHeight) return false;
+        return mMask.test(where.x + where.y * mWidth);
+    }
+
+    bool empty() const { return mTiles.empty(); }
+    unsigned size() const { return mTiles.size(); }
+    const std::vector<Coord>& tiles() const { return mTiles; }
+    std::vector<Coord>::const_iterator begin() const { return mTiles.begin(); }
+    std::vector<Coord>::const_iterator end() const { return mTiles.end(); }
+private:
+    int mWidth, mHeight;
+    std::vector<Coord> mTiles;
+    BitPlane mMask;
 };
 
 
@@ -444,13 +681,23 @@ struct Room {
     bool isFilled;
 
     int area() const;
-    Coord getPointWithin() const;
+    Coord getPointWithin(RNG &rng) const;
 };
 
 
+// Counts of the things that went wrong while generating a level, reported by
+// the map generation statistics mode of morph-sim.
+struct MapgenStats {
+    unsigned retries;
+    unsigned doorFailures;
+    unsigned actorFailures;
+    unsigned itemFailures;
+};
+
 class Dungeon {
 public:
     Dungeon(const DungeonData &data, int width, int height);
+    ~Dungeon();
 
     int depth() const { return mDepth; };
     int width() const { return mWidth; };
@@ -466,8 +713,8 @@ public:
     void replaceTile(int fromTile, int toTile);
     void calcDistances(const Coord &fromWhere);
     Coord nearestOpenTile(const Coord &source, bool allowActor=true, bool allowItem=false) const;
-    Coord randomOpenTile(bool allowActor=false, bool allowItem=true) const;
-    Coord randomOfTile(int theTile) const;
+    Coord randomOpenTile(RNG &rng, bool allowActor=false, bool allowItem=true) const;
+    Coord randomOfTile(RNG &rng, int theTile) const;
     Coord firstOfTile(int theTile) const;
 
     bool isValidPosition(const Coord &where) const;
@@ -476,8 +723,10 @@ public:
     int distanceAt(const Coord &where) const;
     int floorAt(const Coord &where) const;
     void floorAt(const Coord &where, int toTile);
-    const MapTile* at(const Coord &where) const;
-    MapTile* at(const Coord &where);
+    int temperatureAt(const Coord &where) const;
+    void temperatureAt(const Coord &where, int toTemperature);
+    bool isOpaque(const Coord &where) const;
+    bool isPassable(const Coord &where) const;
 
     bool isSeen(const Coord &where) const;
     bool everSeen(const Coord &where) const;
@@ -491,14 +740,17 @@ public:
     bool tryActorStep(Actor *who, Direction dir);
     bool tryActorStepApprox(Actor *who, Direction dir);
     bool removeActor(Actor *who);
+    const std::vector<Actor*>& getActors() const { return mActors; }
     const Actor* actorAt(const Coord &where) const;
     Actor* actorAt(const Coord &where);
     void resetSpeedCounter();
+    void updateSchedule(Actor *who);
 
     bool addItem(Item *what, const Coord &where);
     bool removeItem(Item *what);
     const Item* itemAt(const Coord &where) const;
     Item* itemAt(const Coord &where);
+    const std::vector<Item*>& itemsAt(const Coord &where) const;
 
     void addRoom(const Room &room);
     int roomCount() const { return mRooms.size(); }
@@ -513,20 +765,93 @@ public:
     void tick(World &world);
 
     void clearFovCalc();
-    std::vector<Coord> getEffectArea(const Coord &origin, const Coord &target, int areaType, int maxRange, bool includeWalls, bool includeOrigin);
-    bool inOverlay(const Coord &where) const;
-    void activateAbility(World &world, unsigned ident, const Coord &cursorPos, const std::vector<Coord> &targetArea);
+    bool inFovCalc(const Coord &where) const;
+    void setFovCalc(const Coord &where, bool inCalc);
+    // direct access to the packed planes for the FOV code; positions must be
+    // on the map and ranges run up to but not including last
+    const BitPlane& opaquePlane() const { return mOpaque; }
+    const BitPlane& opaqueColumns() const { return mOpaqueColumns; }
+    void setSeenAt(unsigned pos) { mSeen.set(pos); }
+    void setSeenRange(unsigned first, unsigned last) { mSeen.fill(first, last); }
+    void setFovCalcAt(unsigned pos) {
+        mFovCalc.set(pos);
+        if (pos < mFovCalcFirst) mFovCalcFirst = pos;
+        if (pos > mFovCalcLast) mFovCalcLast = pos;
+    }
+    void setFovCalcRange(unsigned first, unsigned last) {
+        if (first >= last) return;
+        mFovCalc.fill(first, last);
+        if (first < mFovCalcFirst) mFovCalcFirst = first;
+        if (last - 1 > mFovCalcLast) mFovCalcLast = last - 1;
+    }
+    void getEffectArea(const Coord &origin, const Coord &target, int areaType, int maxRange, bool includeWalls, bool includeOrigin, EffectArea &area);
+    void activateAbility(World &world, unsigned ident, const Coord &cursorPos, const EffectArea &targetArea);
+    const DistanceMap& playerDistances(const Coord &playerPos);
+    // whether an actor standing at one position can see another; answers are
+    // remembered until the terrain changes
+    bool canSee(const Coord &from, const Coord &to);
+    // fills seers with every living actor that can see the given position
+    void actorsThatSee(const Coord &where, std::vector<Actor*> &seers);
+
+    // terrain, rooms, and items; the actors are saved by the World
+    void saveLevel(SaveFile &save) const;
+    bool loadLevel(SaveFile &save);
 
     std::vector<Coord> overlayTiles;
     int overlayR, overlayG, overlayB;
     int overlayGlyph;
     const DungeonData &data;
+    MapgenStats mapgenStats;
 private:
+    void setFloor(unsigned pos, int toTile);
+    void refreshTileFlags();
+
     int mDepth;
     int mWidth, mHeight;
     std::vector<Room> mRooms;
     std::vector<Actor*> mActors;
-    MapTile *mData;
+    ActorScheduler mSchedule;
+
+    // tile data is stored as one plane per property so that the passes that
+    // only look at one property don't have to drag the rest through the cache
+    std::vector<uint8_t> mFloor;
+    // cached from the tile flags of each floor; kept in sync by setFloor
+    BitPlane mOpaque, mPassable;
+    // mOpaque transposed, indexed by x * height + y, so that a column of the
+    // map can be read as a run of bits
+    BitPlane mOpaqueColumns;
+    // the positions holding each kind of tile, in no particular order, and
+    // where in its list each position sits; also kept in sync by setFloor
+    std::vector<unsigned> mTilePositions[MAX_TILE_IDENT + 1];
+    std::vector<unsigned> mTileSlot;
+    // the same again for every passable position, for randomOpenTile
+    std::vector<unsigned> mPassablePositions;
+    std::vector<unsigned> mPassableSlot;
+    BitPlane mSeen, mEverSeen, mFovCalc;
+    // where mSeen was last calculated from, and the terrain at the time
+    Coord mSeenFrom;
+    unsigned mSeenVersion;
+    // bounds of the bits set in mFovCalc since it was last cleared, so that a
+    // small area on a large level costs no more than on a small one
+    unsigned mFovCalcFirst, mFovCalcLast;
+    // reused by getEffectArea for line areas
+    std::vector<Coord> mLine;
+    DistanceMap mDistances;
+    // distances to the player, for monsters hunting them; recalculated only
+    // once the player has moved or the terrain has changed
+    DistanceMap mPlayerDistances;
+    Coord mPlayerDistancesFrom;
+    unsigned mPlayerDistancesVersion;
+    // bumped whenever a tile changes
+    unsigned mTerrainVersion;
+    // results of canSee, keyed by the positions at each end, and the terrain
+    // they were found on
+    std::unordered_map<uint64_t, bool> mSightCache;
+    unsigned mSightVersion;
+    std::vector<int8_t> mTemperature;
+    std::vector<Actor*> mOccupant;
+    // most tiles are empty, so items are kept by position only where present
+    std::map<unsigned, std::vector<Item*>> mItems;
 };
 
 
@@ -551,12 +876,82 @@ public:
     uint64_t gameSeed;
     bool showCombatMath;
     GameState gameState;
+    // independent random streams derived from the game seed, so that extra
+    // draws in one part of the game don't change what happens in another;
+    // each level is generated from a generator of its own
+    RNG combatRNG;
+    RNG aiRNG;
 
     Dungeon* getDungeon(int depth);
+    void pregenerateLevels(int aroundDepth);
     bool movePlayerToDepth(int newDepth, int enterFrom);
     void addMessage(const std::string &text);
 
     void tick();
+private:
+    // levels being generated in the background, by depth
+    std::map<int, std::future<Dungeon*>> mPendingLevels;
+};
+
+
+// the random streams of a game; see gameStream. Each level has its own, counting
+// up from RNG_STREAM_LEVELS by the level's ident.
+const unsigned RNG_STREAM_COMBAT = 0;
+const unsigned RNG_STREAM_AI = 1;
+const unsigned RNG_STREAM_LEVELS = 2;
+
+const uint32_t SAVE_MAGIC = 0x534c524d; // "MRLS"
+const unsigned SAVE_VERSION = 2;
+const char* const SAVE_FILENAME = "game.sav";
+
+// The contents of a saved game, built up in memory and written to (or read
+// from) disk in one go. Values are stored little-endian, tile planes as runs of
+// identical bytes, and game data by ident. Actors refer to each other by their
+// position in the save, which the World sets up with setActorRefs before
+// writing any actors.
+// A read past the end of the data or of something that doesn't fit sets the
+// error flag and returns zero, so callers only need to check hasError() once
+// they're done.
+class SaveFile {
+public:
+    SaveFile();
+
+    bool readFromFile(const std::string &filename);
+    bool writeToFile(const std::string &filename) const;
+    bool hasError() const { return mError; }
+    void setError() { mError = true; }
+
+    void writeByte(unsigned value);
+    void writeInt(uint32_t value);
+    void writeLong(uint64_t value);
+    void writeString(const std::string &text);
+    void writeCoord(const Coord &where);
+    void writeRuns(const std::vector<uint8_t> &plane);
+    void writeItem(const Item *item);
+    void writeActor(const Actor *actor);
+
+    unsigned readByte();
+    uint32_t readInt();
+    uint64_t readLong();
+    std::string readString();
+    Coord readCoord();
+    void readRuns(std::vector<uint8_t> &plane);
+    Item* readItem();
+    Actor* readActor();
+
+    void setActorRefs(const std::vector<Actor*> &actors);
+    void resolveActorRefs();
+private:
+    void writeCount(unsigned count);
+    unsigned readCount();
+
+    std::vector<uint8_t> mData;
+    unsigned mPosition;
+    bool mError;
+    // actors in the order they're saved, and the status effects waiting to
+    // have their source looked up once every actor has been loaded
+    std::vector<Actor*> mActorRefs;
+    std::vector<std::pair<StatusItem*, unsigned>> mPendingSources;
 };
 
 
@@ -572,20 +967,12 @@ struct Document {
     std::vector<DocumentImage> images;
 };
 
-template<class T>
-bool vectorContains(std::vector<T> &v, T item) {
-    for (const T &iter : v) {
-        if (iter == item) return true;
-    }
-    return false;
-}
-
 
 int percentOf(int percent, int ofValue);
 std::string ucFirst(std::string text);
 std::vector<std::string> explode(const std::string &text, char onChar);
 std::vector<std::string> explodeOnWhitespace(std::string text);
-const std::string& trim(const std::string &text);
+std::string trim(const std::string &text);
 std::string& trim(std::string &text);
 std::string intToString(long long number);
 bool strToInt(const std::string &text, unsigned &result);
@@ -599,11 +986,8 @@ Document* loadDocument(const std::string &filename);
 Image* loadImage(const std::string &filename);
 void drawImage(int originX, int originY, Image *image);
 
-Direction randomDirection();
-Direction randomCardinalDirection();
-Direction rotate45(Direction d);
-Direction unrotate45(Direction d);
-Direction rotate90(Direction d);
+Direction randomDirection(RNG &rng);
+Direction randomCardinalDirection(RNG &rng);
 
 std::string makeItemList(const std::vector<Item*> &itemList, unsigned maxList);
 std::string statName(int statNumber);
@@ -616,22 +1000,37 @@ std::string readFile(const std::string &filename);
 std::vector<unsigned char> readFileAsBinary(const std::string &filename);
 const ActorData& getActorData(unsigned ident);
 const ItemData& getItemData(unsigned ident);
-const MutationData& getRandomMutationData(Actor *forWho);
+const MutationData& getRandomMutationData(Actor *forWho, RNG &rng);
 const AbilityData& getAbilityData(unsigned ident);
 const MutationData& getMutationData(unsigned ident);
 const StatusData& getStatusData(unsigned ident);
 const TileData& getTileData(unsigned ident);
+unsigned getTileFlags(unsigned ident);
 unsigned getDungeonEntranceIdent();
 const DungeonData& getDungeonData(unsigned ident);
 
 std::string buildCombatMessage(Actor *attacker, Actor *victim, const AttackData &attackData, bool showCalc);
-std::string triggerEffect(const EffectData &effect, Actor *user, Actor *target);
+std::string triggerEffect(const EffectData &effect, Actor *user, Actor *target, RNG &rng);
+// the FOV engines; both produce the same visible tiles
+const int FOV_DIAMOND_WALLS = 0;    // the original per-tile implementation
+const int FOV_BIT_PARALLEL = 1;     // works on a column of tiles at a time
+void setFovEngine(int engine);
+int getFovEngine();
 void handlePlayerFOV(Dungeon *dungeon, Actor *player);
 void fovCalcBeam(Dungeon *dungeon, const Coord &origin, Direction dir, int maxRange);
 void fovCalcBurst(Dungeon *dungeon, const Coord &origin, int maxRange);
+// builds the lookup tables for fixed range FOV; called once the data is loaded
+void buildFovTables(const std::vector<int> &radii);
 std::vector<Coord> calcLine(const Dungeon &map, const Coord &start, const Coord &end, bool stopOpaque, bool stopSolid);
-void doMapgen(Dungeon &d);
-void spawnActors(Dungeon &d, bool forRefresh);
+// as above, but fills a caller's vector so that it can be reused
+void calcLine(const Dungeon &map, const Coord &start, const Coord &end, bool stopOpaque, bool stopSolid, std::vector<Coord> &results);
+bool lineIsClear(const Dungeon &map, const Coord &start, const Coord &end);
+void doMapgen(Dungeon &d, RNG &rng);
+Dungeon* generateDungeon(const DungeonData &dungeonData, uint64_t gameSeed);
+World* createGame(uint64_t gameSeed, unsigned iteration);
+bool saveGame(const World &world, const std::string &filename);
+World* loadGame(const std::string &filename);
+void spawnActors(Dungeon &d, RNG &rng, bool forRefresh);
 void activateItem(World &world, Item *item, Actor *user);
 
 void ui_alertBox(const std::string &title, const std::string &message);
@@ -641,7 +1040,6 @@ void logMessage(int logLevel, std::string message);
 bool loadConfigData(const std::string &filename);
 
 extern ConfigData configData;
-extern RNG globalRNG;
 
 const KeyBinding& getBindingForKey(int keyPressed, unsigned currentMode);
 const std::string& getNameForAction(int action);
@@ -66,7 +66,7 @@ void tryMeleeAttack(World &world, Direction dir) {
         return;
     }
 
-    AttackData attackData = world.player->meleeAttack(actor);
+    AttackData attackData = world.player->meleeAttack(actor, world.combatRNG);
     world.addMessage(buildCombatMessage(world.player, actor, attackData, configData.getBoolValue("show_combat_math", false)));
     world.player->advanceSpeedCounter();
     world.tick();
@@ -129,12 +129,12 @@ void tryMovePlayer(World &world, Direction dir) {
 
     bool isOverBurdened = world.player->isOverBurdened();
     if (!isOverBurdened && world.map->tryActorStep(world.player, dir)) {
-        const MapTile *tile = world.map->at(world.player->position);
-        if (tile && !tile->items.empty()) {
+        const std::vector<Item*> &items = world.map->itemsAt(world.player->position);
+        if (!items.empty()) {
             std::stringstream s;
-            if (tile->items.size() == 1) s << "Item here: ";
+            if (items.size() == 1) s << "Item here: ";
             else s << "Items here: ";
-            s << makeItemList(tile->items, 4) << '.';
+            s << makeItemList(items, 4) << '.';
             world.addMessage(s.str());
         }
         world.player->advanceSpeedCounter();
@@ -152,16 +152,16 @@ void tryMovePlayer(World &world, Direction dir) {
 }
 
 void tryPlayerTakeItem(World &world) {
-    MapTile *tile = world.map->at(world.player->position);
-    if (!tile) {
+    if (!world.map->isValidPosition(world.player->position)) {
         logMessage(LOG_ERROR, "Tried to take item while player outside map.");
         return;
     }
 
-    if (tile->items.empty()) {
+    const std::vector<Item*> &items = world.map->itemsAt(world.player->position);
+    if (items.empty()) {
         world.addMessage("Nothing to take!");
-    } else if (tile->items.size() == 1) {
-        Item *item = tile->items[0];
+    } else if (items.size() == 1) {
+        Item *item = items[0];
         world.map->removeItem(item);
         world.player->addItem(item);
         world.player->advanceSpeedCounter();
@@ -215,7 +215,7 @@ void debug_addThing(World &world, int thingType) {
             if (itemData.ident == BAD_VALUE) {
                 ui_alertBox("Error", "Unknown item ident.");
             } else {
-                Item *item = new Item(itemData);
+                Item *item = new Item(itemData, world.combatRNG);
                 world.player->addItem(item);
                 world.addMessage("[color=cyan]DEBUG[/color] give item " + itemData.name);
             }
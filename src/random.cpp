@@ -34,11 +34,107 @@ uint64_t RNG::next32() {
     return next64() >> 32;
 }
 
+// Returns a value from 0 to max - 1 (or 0 if max is less than one). Uses
+// Lemire's multiply-shift method, which takes the high half of a 32x32 bit
+// product instead of dividing, and rejects the few products that would make
+// the smallest results more likely than the rest.
 int RNG::upto(int max) {
-    return next32() % max;
+    if (max <= 0) return 0;
+    uint32_t bound = max;
+    uint64_t product = next32() * static_cast<uint64_t>(bound);
+    uint32_t low = product;
+    if (low < bound) {
+        uint32_t threshold = -bound % bound;
+        while (low < threshold) {
+            product = next32() * static_cast<uint64_t>(bound);
+            low = product;
+        }
+    }
+    return product >> 32;
 }
 
 int RNG::between(int min, int max) {
     int range = max - min + 1;
     return min + upto(range);
 }
+
+// Fills values with count results of upto(max). The rejection threshold is
+// worked out once for the whole batch rather than once per rejection.
+void RNG::fill(int *values, unsigned count, int max) {
+    if (max <= 0) {
+        for (unsigned i = 0; i < count; ++i) values[i] = 0;
+        return;
+    }
+    uint32_t bound = max;
+    uint32_t threshold = -bound % bound;
+    for (unsigned i = 0; i < count; ++i) {
+        uint64_t product;
+        do {
+            product = next32() * static_cast<uint64_t>(bound);
+        } while (static_cast<uint32_t>(product) < threshold);
+        values[i] = product >> 32;
+    }
+}
+
+// The generator's state update is linear over GF(2), so advancing it by any
+// number of steps is a multiplication by a power of its 64x64 bit transition
+// matrix. Each matrix is stored as its 64 columns.
+struct StepMatrix {
+    uint64_t column[64];
+
+    uint64_t apply(uint64_t state) const {
+        uint64_t result = 0;
+        for (int i = 0; state; ++i, state >>= 1) {
+            if (state & 1) result ^= column[i];
+        }
+        return result;
+    }
+};
+
+static StepMatrix makeJumpMatrix() {
+    StepMatrix m;
+    for (int i = 0; i < 64; ++i) {
+        uint64_t state = 1ULL << i;
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        m.column[i] = state;
+    }
+    // square the single step matrix 32 times to get the one for 2^32 steps
+    for (int n = 0; n < 32; ++n) {
+        StepMatrix squared;
+        for (int i = 0; i < 64; ++i) squared.column[i] = m.apply(m.column[i]);
+        m = squared;
+    }
+    return m;
+}
+
+// Advances the generator by 2^32 steps, as if next64 had been called that many
+// times.
+void RNG::jump() {
+    static const StepMatrix jumpMatrix = makeJumpMatrix();
+    mState = jumpMatrix.apply(mState);
+}
+
+// Returns a generator that carries on from this one's current position, and
+// jumps this one ahead. The two won't overlap for at least 2^32 draws.
+RNG RNG::split() {
+    RNG result(*this);
+    jump();
+    return result;
+}
+
+// Returns the generator for one numbered stream of a game. Every stream of a
+// game starts from the game seed put through the splitmix64 mixing function,
+// so that neighbouring game seeds don't produce related sequences, and is then
+// jumped ahead once per stream number, so no two streams overlap.
+RNG gameStream(uint64_t gameSeed, unsigned stream) {
+    uint64_t z = gameSeed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    // a seed of zero means "seed from the clock"
+    RNG result(z ? z : 1);
+    for (unsigned i = 0; i < stream; ++i) result.jump();
+    return result;
+}
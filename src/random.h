@@ -15,8 +15,14 @@ public:
 
     int upto(int max);
     int between(int min, int max);
+    void fill(int *values, unsigned count, int max);
+
+    void jump();
+    RNG split();
 private:
     uint64_t mState;
 };
 
+RNG gameStream(uint64_t gameSeed, unsigned stream);
+
 #endif // RANDOM_H
\ No newline at end of file
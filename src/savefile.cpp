@@ -0,0 +1,444 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "physfs.h"
+#include "morph.h"
+
+
+SaveFile::SaveFile()
+: mPosition(0), mError(false)
+{ }
+
+// saves go to the write directory, which is mounted for reading as /saves
+bool SaveFile::readFromFile(const std::string &filename) {
+    const std::string fullName = "/saves/" + filename;
+    PHYSFS_File *fp = PHYSFS_openRead(fullName.c_str());
+    if (!fp) {
+        std::string errorMessage = "Failed to read save file " + filename + ": ";
+        errorMessage += PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode());
+        logMessage(LOG_ERROR, errorMessage);
+        return false;
+    }
+    auto length = PHYSFS_fileLength(fp);
+    if (length < 0) {
+        logMessage(LOG_ERROR, "Save file " + filename + " is of indeterminate length.");
+        PHYSFS_close(fp);
+        return false;
+    }
+    mData.resize(length);
+    mPosition = 0;
+    mError = false;
+    auto bytesRead = PHYSFS_readBytes(fp, mData.data(), length);
+    PHYSFS_close(fp);
+    if (bytesRead != length) {
+        std::string errorMessage = "Failed to read save file " + filename + ": ";
+        errorMessage += PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode());
+        logMessage(LOG_ERROR, errorMessage);
+        return false;
+    }
+    return true;
+}
+
+bool SaveFile::writeToFile(const std::string &filename) const {
+    PHYSFS_File *fp = PHYSFS_openWrite(filename.c_str());
+    if (!fp) {
+        std::string errorMessage = "Failed to create save file " + filename + ": ";
+        errorMessage += PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode());
+        logMessage(LOG_ERROR, errorMessage);
+        return false;
+    }
+    auto bytesWritten = PHYSFS_writeBytes(fp, mData.data(), mData.size());
+    bool success = bytesWritten == static_cast<PHYSFS_sint64>(mData.size());
+    if (!success) {
+        std::string errorMessage = "Failed to write save file " + filename + ": ";
+        errorMessage += PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode());
+        logMessage(LOG_ERROR, errorMessage);
+    }
+    PHYSFS_close(fp);
+    return success;
+}
+
+
+/* ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****
+ * BASIC VALUES
+ * ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****/
+
+void SaveFile::writeByte(unsigned value) {
+    mData.push_back(value & 0xFF);
+}
+
+void SaveFile::writeInt(uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        mData.push_back(value & 0xFF);
+        value >>= 8;
+    }
+}
+
+void SaveFile::writeLong(uint64_t value) {
+    writeInt(value & 0xFFFFFFFF);
+    writeInt(value >> 32);
+}
+
+// counts are usually small, so they're stored seven bits to the byte with the
+// high bit marking that more bytes follow
+void SaveFile::writeCount(unsigned count) {
+    while (count >= 0x80) {
+        mData.push_back((count & 0x7F) | 0x80);
+        count >>= 7;
+    }
+    mData.push_back(count);
+}
+
+void SaveFile::writeString(const std::string &text) {
+    writeCount(text.size());
+    mData.insert(mData.end(), text.begin(), text.end());
+}
+
+void SaveFile::writeCoord(const Coord &where) {
+    writeInt(where.x);
+    writeInt(where.y);
+}
+
+void SaveFile::writeRuns(const std::vector<uint8_t> &plane) {
+    unsigned pos = 0;
+    while (pos < plane.size()) {
+        unsigned runEnd = pos + 1;
+        while (runEnd < plane.size() && plane[runEnd] == plane[pos]) ++runEnd;
+        writeCount(runEnd - pos);
+        writeByte(plane[pos]);
+        pos = runEnd;
+    }
+}
+
+unsigned SaveFile::readByte() {
+    if (mPosition >= mData.size()) {
+        mError = true;
+        return 0;
+    }
+    return mData[mPosition++];
+}
+
+uint32_t SaveFile::readInt() {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(readByte()) << (i * 8);
+    }
+    return value;
+}
+
+uint64_t SaveFile::readLong() {
+    uint64_t low = readInt();
+    uint64_t high = readInt();
+    return low | (high << 32);
+}
+
+unsigned SaveFile::readCount() {
+    unsigned count = 0;
+    for (int shift = 0; shift < 32; shift += 7) {
+        unsigned byte = readByte();
+        count |= (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return count;
+    }
+    mError = true;
+    return 0;
+}
+
+std::string SaveFile::readString() {
+    unsigned length = readCount();
+    if (mError || length > mData.size() - mPosition) {
+        mError = true;
+        return "";
+    }
+    std::string text(mData.begin() + mPosition, mData.begin() + mPosition + length);
+    mPosition += length;
+    return text;
+}
+
+Coord SaveFile::readCoord() {
+    Coord where;
+    where.x = static_cast<int32_t>(readInt());
+    where.y = static_cast<int32_t>(readInt());
+    return where;
+}
+
+// the plane must already be the size of the saved plane
+void SaveFile::readRuns(std::vector<uint8_t> &plane) {
+    unsigned pos = 0;
+    while (pos < plane.size() && !mError) {
+        unsigned runLength = readCount();
+        uint8_t value = readByte();
+        if (runLength == 0 || runLength > plane.size() - pos) {
+            mError = true;
+            return;
+        }
+        std::fill(plane.begin() + pos, plane.begin() + pos + runLength, value);
+        pos += runLength;
+    }
+}
+
+
+/* ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****
+ * GAME OBJECTS
+ * ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****/
+
+void SaveFile::writeItem(const Item *item) {
+    writeInt(item->data.ident);
+    writeCoord(item->position);
+    writeByte(item->isEquipped);
+    writeInt(item->chargesLeft);
+}
+
+Item* SaveFile::readItem() {
+    const ItemData &data = getItemData(readInt());
+    if (data.ident == BAD_VALUE) {
+        mError = true;
+        return nullptr;
+    }
+    // the charges are loaded below rather than rolled
+    RNG unusedRNG(1);
+    Item *item = new Item(data, unusedRNG);
+    item->position = readCoord();
+    item->isEquipped = readByte();
+    item->chargesLeft = static_cast<int32_t>(readInt());
+    return item;
+}
+
+void SaveFile::setActorRefs(const std::vector<Actor*> &actors) {
+    mActorRefs = actors;
+}
+
+void SaveFile::writeActor(const Actor *actor) {
+    writeInt(actor->data.ident);
+    writeInt(actor->ident);
+    writeCoord(actor->position);
+    writeByte(actor->isPlayer);
+    writeInt(actor->level);
+    writeInt(actor->xp);
+    writeInt(actor->advancementPoints);
+    writeCoord(actor->playerLastSeenPosition);
+    writeInt(actor->speedCounter);
+    writeInt(actor->health);
+    writeInt(actor->energy);
+    writeInt(actor->turnsSinceCombatAction);
+    for (int i = 0; i < STAT_BASE_COUNT; ++i) {
+        writeInt(actor->statLevels[i]);
+    }
+
+    writeCount(actor->inventory.size());
+    for (const Item *item : actor->inventory) writeItem(item);
+
+    writeCount(actor->statusEffects.size());
+    for (const StatusItem *status : actor->statusEffects) {
+        writeInt(status->data.ident);
+        writeInt(status->duration);
+        // the source may have since left the game; zero means no source
+        unsigned sourceRef = 0;
+        for (unsigned i = 0; i < mActorRefs.size(); ++i) {
+            if (mActorRefs[i] == status->fromWho) {
+                sourceRef = i + 1;
+                break;
+            }
+        }
+        writeCount(sourceRef);
+    }
+
+    writeCount(actor->mutations.size());
+    for (const MutationItem *mutation : actor->mutations) {
+        writeInt(mutation->data.ident);
+    }
+}
+
+Actor* SaveFile::readActor() {
+    const ActorData &data = getActorData(readInt());
+    if (data.ident == BAD_VALUE) {
+        mError = true;
+        return nullptr;
+    }
+    Actor *actor = new Actor(data, readInt());
+    actor->position = readCoord();
+    actor->isPlayer = readByte();
+    actor->level = static_cast<int32_t>(readInt());
+    actor->xp = static_cast<int32_t>(readInt());
+    actor->advancementPoints = static_cast<int32_t>(readInt());
+    actor->playerLastSeenPosition = readCoord();
+    actor->speedCounter = readInt();
+    actor->health = static_cast<int32_t>(readInt());
+    actor->energy = static_cast<int32_t>(readInt());
+    actor->turnsSinceCombatAction = readInt();
+    for (int i = 0; i < STAT_BASE_COUNT; ++i) {
+        actor->statLevels[i] = static_cast<int32_t>(readInt());
+    }
+
+    unsigned itemCount = readCount();
+    for (unsigned i = 0; i < itemCount && !mError; ++i) {
+        Item *item = readItem();
+        if (item) actor->inventory.push_back(item);
+    }
+
+    unsigned statusCount = readCount();
+    for (unsigned i = 0; i < statusCount && !mError; ++i) {
+        const StatusData &statusData = getStatusData(readInt());
+        if (statusData.ident == BAD_VALUE) {
+            mError = true;
+            break;
+        }
+        StatusItem *status = new StatusItem(statusData);
+        status->fromWho = nullptr;
+        status->duration = readInt();
+        mPendingSources.push_back(std::make_pair(status, readCount()));
+        actor->statusEffects.push_back(status);
+    }
+
+    unsigned mutationCount = readCount();
+    for (unsigned i = 0; i < mutationCount && !mError; ++i) {
+        const MutationData &mutationData = getMutationData(readInt());
+        if (mutationData.ident == BAD_VALUE) {
+            mError = true;
+            break;
+        }
+        actor->mutations.push_back(new MutationItem(mutationData));
+    }
+
+    mActorRefs.push_back(actor);
+    return actor;
+}
+
+// status effect sources can be any actor in the save, including ones that
+// come later in the file, so they're filled in once everything is loaded
+void SaveFile::resolveActorRefs() {
+    for (auto &pending : mPendingSources) {
+        if (pending.second == 0) continue;
+        if (pending.second > mActorRefs.size()) {
+            mError = true;
+            continue;
+        }
+        pending.first->fromWho = mActorRefs[pending.second - 1];
+    }
+    mPendingSources.clear();
+}
+
+
+/* ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****
+ * WHOLE GAMES
+ * Filenames are relative to the save directory.
+ * ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****/
+
+bool saveGame(const World &world, const std::string &filename) {
+    if (!world.player || !world.map) {
+        logMessage(LOG_ERROR, "Tried to save a game with no player or current level.");
+        return false;
+    }
+
+    SaveFile save;
+    save.writeInt(SAVE_MAGIC);
+    save.writeInt(SAVE_VERSION);
+    save.writeLong(world.gameSeed);
+    save.writeLong(world.combatRNG.getState());
+    save.writeLong(world.aiRNG.getState());
+    save.writeInt(world.currentTurn);
+    save.writeByte(world.disableFOV);
+    save.writeByte(world.showCombatMath);
+    save.writeByte(static_cast<unsigned>(world.gameState));
+
+    save.writeInt(world.messages.size());
+    for (const LogMessage &message : world.messages) {
+        save.writeString(message.text);
+    }
+
+    std::vector<Actor*> allActors;
+    for (const Dungeon *level : world.levels) {
+        const std::vector<Actor*> &actors = level->getActors();
+        allActors.insert(allActors.end(), actors.begin(), actors.end());
+    }
+    save.setActorRefs(allActors);
+
+    save.writeInt(world.levels.size());
+    for (const Dungeon *level : world.levels) {
+        save.writeInt(level->data.ident);
+        save.writeInt(level->width());
+        save.writeInt(level->height());
+        level->saveLevel(save);
+        // actors are saved in the order they arrived on the level, which is
+        // also how ties in the turn order are broken
+        const std::vector<Actor*> &actors = level->getActors();
+        save.writeInt(actors.size());
+        for (const Actor *actor : actors) save.writeActor(actor);
+    }
+
+    return save.writeToFile(filename);
+}
+
+World* loadGame(const std::string &filename) {
+    SaveFile save;
+    if (!save.readFromFile(filename)) return nullptr;
+    if (save.readInt() != SAVE_MAGIC) {
+        logMessage(LOG_ERROR, filename + " is not a saved game.");
+        return nullptr;
+    }
+    unsigned version = save.readInt();
+    if (version != SAVE_VERSION) {
+        logMessage(LOG_ERROR, filename + " has unsupported save version " + std::to_string(version) + ".");
+        return nullptr;
+    }
+
+    World *world = new World;
+    world->gameSeed = save.readLong();
+    world->combatRNG.seed(save.readLong());
+    world->aiRNG.seed(save.readLong());
+    world->currentTurn = save.readInt();
+    world->disableFOV = save.readByte();
+    world->showCombatMath = save.readByte();
+    world->gameState = save.readByte() ? GameState::Victory : GameState::Normal;
+
+    unsigned messageCount = save.readInt();
+    for (unsigned i = 0; i < messageCount && !save.hasError(); ++i) {
+        world->addMessage(save.readString());
+    }
+
+    unsigned levelCount = save.readInt();
+    for (unsigned i = 0; i < levelCount && !save.hasError(); ++i) {
+        const DungeonData &data = getDungeonData(save.readInt());
+        int width = save.readInt();
+        int height = save.readInt();
+        if (data.ident == BAD_VALUE || width <= 0 || height <= 0 || width > MAX_MAP_SIZE || height > MAX_MAP_SIZE) {
+            save.setError();
+            break;
+        }
+        Dungeon *level = new Dungeon(data, width, height);
+        world->levels.push_back(level);
+        if (!level->loadLevel(save)) break;
+
+        unsigned actorCount = save.readInt();
+        for (unsigned j = 0; j < actorCount && !save.hasError(); ++j) {
+            Actor *actor = save.readActor();
+            if (!actor) break;
+            // levels don't delete the player, so a second one would be lost
+            if (actor->isPlayer && world->player) {
+                save.setError();
+                delete actor;
+                break;
+            }
+            if (!level->addActor(actor, actor->position)) {
+                save.setError();
+                delete actor;
+                break;
+            }
+            if (actor->isPlayer) {
+                world->player = actor;
+                world->map = level;
+            }
+        }
+    }
+    save.resolveActorRefs();
+
+    if (save.hasError() || !world->player) {
+        logMessage(LOG_ERROR, "Save file " + filename + " is damaged.");
+        delete world;
+        return nullptr;
+    }
+
+    world->map->doActorFOV(world->player);
+    world->pregenerateLevels(world->map->depth());
+    return world;
+}
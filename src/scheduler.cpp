@@ -0,0 +1,102 @@
+#include <algorithm>
+
+#include "morph.h"
+
+
+void ActorScheduler::add(Actor *actor) {
+    actor->scheduleOrder = mNextOrder++;
+    mHeap.push_back(actor);
+    actor->scheduleSlot = mHeap.size() - 1;
+    siftUp(actor->scheduleSlot);
+}
+
+void ActorScheduler::remove(Actor *actor) {
+    if (actor->scheduleSlot >= 0) {
+        removeAt(actor->scheduleSlot);
+    } else {
+        auto iter = std::find(mSetAside.begin(), mSetAside.end(), actor);
+        if (iter != mSetAside.end()) mSetAside.erase(iter);
+    }
+}
+
+// called after an actor's speedCounter has changed
+void ActorScheduler::update(Actor *actor) {
+    if (actor->scheduleSlot < 0) return;
+    siftUp(actor->scheduleSlot);
+    siftDown(actor->scheduleSlot);
+}
+
+// called after the speedCounter of many actors has changed at once
+void ActorScheduler::rebuild() {
+    for (unsigned i = mHeap.size() / 2; i-- > 0; ) {
+        siftDown(i);
+    }
+}
+
+Actor* ActorScheduler::next() {
+    for (auto iter = mSetAside.begin(); iter != mSetAside.end(); ) {
+        if ((*iter)->isDead()) {
+            ++iter;
+        } else {
+            Actor *actor = *iter;
+            iter = mSetAside.erase(iter);
+            mHeap.push_back(actor);
+            actor->scheduleSlot = mHeap.size() - 1;
+            siftUp(actor->scheduleSlot);
+        }
+    }
+    while (!mHeap.empty() && mHeap.front()->isDead()) {
+        Actor *actor = mHeap.front();
+        removeAt(0);
+        mSetAside.push_back(actor);
+    }
+    if (mHeap.empty()) return nullptr;
+    return mHeap.front();
+}
+
+bool ActorScheduler::before(const Actor *lhs, const Actor *rhs) const {
+    if (lhs->speedCounter != rhs->speedCounter) return lhs->speedCounter < rhs->speedCounter;
+    return lhs->scheduleOrder < rhs->scheduleOrder;
+}
+
+void ActorScheduler::place(unsigned slot, Actor *actor) {
+    mHeap[slot] = actor;
+    actor->scheduleSlot = slot;
+}
+
+void ActorScheduler::siftUp(unsigned slot) {
+    Actor *actor = mHeap[slot];
+    while (slot > 0) {
+        unsigned parent = (slot - 1) / 2;
+        if (!before(actor, mHeap[parent])) break;
+        place(slot, mHeap[parent]);
+        slot = parent;
+    }
+    place(slot, actor);
+}
+
+void ActorScheduler::siftDown(unsigned slot) {
+    Actor *actor = mHeap[slot];
+    const unsigned size = mHeap.size();
+    while (1) {
+        unsigned child = slot * 2 + 1;
+        if (child >= size) break;
+        if (child + 1 < size && before(mHeap[child + 1], mHeap[child])) ++child;
+        if (!before(mHeap[child], actor)) break;
+        place(slot, mHeap[child]);
+        slot = child;
+    }
+    place(slot, actor);
+}
+
+void ActorScheduler::removeAt(unsigned slot) {
+    Actor *actor = mHeap[slot];
+    Actor *last = mHeap.back();
+    mHeap.pop_back();
+    actor->scheduleSlot = -1;
+    if (actor != last) {
+        place(slot, last);
+        siftUp(slot);
+        siftDown(last->scheduleSlot);
+    }
+}
@@ -0,0 +1,522 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "physfs.h"
+#include "morph.h"
+
+
+/* ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****
+ * HEADLESS SIMULATION DRIVER
+ * Runs the game core without a terminal, taking the player's turns from a
+ * simple policy instead of the keyboard. Used for profiling the turn loop and
+ * for soak testing large numbers of seeds. Can also generate every level for
+ * a range of seeds and report statistics on the results.
+ * ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****/
+
+void tryMovePlayer(World &world, Direction dir);
+void tryPlayerTakeItem(World &world);
+void tryPlayerChangeFloor(World &world);
+void restUntilHealed(World &world);
+bool headlessStartup(const char *argv0);
+
+
+enum class SimPolicy {
+    RandomWalk, Wait, Script
+};
+
+struct SimOptions {
+    SimPolicy policy;
+    unsigned maxTurns;
+    bool mapgenOnly;
+    bool fovCheck;
+    unsigned threadCount;
+    std::vector<uint64_t> seeds;
+    std::vector<std::string> script;
+};
+
+struct SimResult {
+    uint64_t seed;
+    unsigned turns;
+    unsigned actions;
+    int deepestLevel;
+    bool playerDied;
+    double seconds;
+};
+
+
+static Direction directionFromName(const std::string &name) {
+    if (name == "north")        return Direction::North;
+    if (name == "northeast")    return Direction::Northeast;
+    if (name == "east")         return Direction::East;
+    if (name == "southeast")    return Direction::Southeast;
+    if (name == "south")        return Direction::South;
+    if (name == "southwest")    return Direction::Southwest;
+    if (name == "west")         return Direction::West;
+    if (name == "northwest")    return Direction::Northwest;
+    return Direction::Unknown;
+}
+
+// perform a single named player action; returns false if the action name
+// isn't recognized
+static bool doScriptAction(World &world, const std::string &action) {
+    if (action == "wait") {
+        world.player->advanceSpeedCounter();
+        world.tick();
+    } else if (action == "rest") {
+        restUntilHealed(world);
+    } else if (action == "take") {
+        tryPlayerTakeItem(world);
+    } else if (action == "stairs") {
+        tryPlayerChangeFloor(world);
+    } else {
+        Direction dir = directionFromName(action);
+        if (dir == Direction::Unknown) return false;
+        tryMovePlayer(world, dir);
+    }
+    return true;
+}
+
+static void doRandomWalkAction(World &world, RNG &rng) {
+    const TileData &td = getTileData(world.map->floorAt(world.player->position));
+    if (td.isDownStair && rng.upto(100) < 50) {
+        tryPlayerChangeFloor(world);
+    } else if (world.map->itemAt(world.player->position) && rng.upto(100) < 50) {
+        tryPlayerTakeItem(world);
+    } else if (world.player->health < world.player->getStat(STAT_HEALTH) / 2
+               && !world.map->hostileIsVisible()) {
+        restUntilHealed(world);
+    } else {
+        tryMovePlayer(world, randomDirection(rng));
+    }
+}
+
+static SimResult runSimulation(const SimOptions &options, uint64_t seed) {
+    SimResult result{seed, 0, 0, 0, false, 0.0};
+    auto startTime = std::chrono::steady_clock::now();
+
+    World *world = createGame(seed, 0);
+    if (!world) {
+        logMessage(LOG_ERROR, "sim: failed to create game for seed " + std::to_string(seed));
+        return result;
+    }
+
+    RNG policyRNG(seed);
+    unsigned scriptPos = 0;
+    // actions that don't take any game time (such as walking into a wall)
+    // could otherwise stall a run forever
+    const unsigned maxActions = options.maxTurns * 20;
+    while (world->currentTurn < options.maxTurns && result.actions < maxActions) {
+        if (world->gameState == GameState::Victory) break;
+        world->player->verify();
+        if (world->player->isDead()) {
+            result.playerDied = true;
+            break;
+        }
+        if (world->map->depth() > result.deepestLevel) result.deepestLevel = world->map->depth();
+        world->map->overlayTiles.clear();
+
+        Actor *next = world->map->getNextActor();
+        if (next && !next->isPlayer) {
+            world->tick();
+            continue;
+        }
+
+        ++result.actions;
+        switch (options.policy) {
+            case SimPolicy::RandomWalk:
+                doRandomWalkAction(*world, policyRNG);
+                break;
+            case SimPolicy::Wait:
+                doScriptAction(*world, "wait");
+                break;
+            case SimPolicy::Script:
+                doScriptAction(*world, options.script[scriptPos]);
+                scriptPos = (scriptPos + 1) % options.script.size();
+                break;
+        }
+    }
+
+    result.turns = world->currentTurn;
+    delete world;
+    auto endTime = std::chrono::steady_clock::now();
+    result.seconds = std::chrono::duration<double>(endTime - startTime).count();
+    return result;
+}
+
+/* ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****
+ * MAP GENERATION STATISTICS
+ * ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****/
+
+struct MapgenResult {
+    uint64_t seed;
+    unsigned levelIdent;
+    bool failed;
+    double milliseconds;
+    MapgenStats stats;
+    int roomCount;
+    double floorRatio;
+};
+
+static MapgenResult generateForStats(const DungeonData &data, uint64_t seed) {
+    MapgenResult result{seed, data.ident, false, 0.0, MapgenStats(), 0, 0.0};
+    auto startTime = std::chrono::steady_clock::now();
+    Dungeon *d = generateDungeon(data, seed);
+    auto endTime = std::chrono::steady_clock::now();
+    result.milliseconds = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+    if (!d) {
+        result.failed = true;
+        return result;
+    }
+    result.stats = d->mapgenStats;
+    result.roomCount = d->roomCount();
+    int floorCount = 0;
+    for (int y = 0; y < d->height(); ++y) {
+        for (int x = 0; x < d->width(); ++x) {
+            if (d->isPassable(Coord(x, y))) ++floorCount;
+        }
+    }
+    result.floorRatio = floorCount / static_cast<double>(d->width() * d->height());
+    delete d;
+    return result;
+}
+
+static void reportMapgenStats(unsigned levelIdent, std::vector<MapgenResult> &results) {
+    std::vector<double> times;
+    unsigned failures = 0, retries = 0, doorFailures = 0, actorFailures = 0, itemFailures = 0;
+    double totalTime = 0.0, totalRooms = 0.0, totalFloor = 0.0;
+    for (const MapgenResult &result : results) {
+        times.push_back(result.milliseconds);
+        totalTime += result.milliseconds;
+        if (result.failed) {
+            ++failures;
+            continue;
+        }
+        retries += result.stats.retries;
+        doorFailures += result.stats.doorFailures;
+        actorFailures += result.stats.actorFailures;
+        itemFailures += result.stats.itemFailures;
+        totalRooms += result.roomCount;
+        totalFloor += result.floorRatio;
+    }
+    std::sort(times.begin(), times.end());
+    double p99 = times[std::min<size_t>(times.size() - 1, times.size() * 99 / 100)];
+    unsigned generated = results.size() - failures;
+    double count = generated ? generated : 1;
+
+    std::cout << std::left << std::setw(7) << levelIdent << std::right;
+    std::cout << std::setw(7) << results.size() << std::setw(7) << failures;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << std::setw(9) << totalTime / results.size() << std::setw(9) << p99;
+    std::cout << std::setw(9) << retries << std::setw(9) << doorFailures;
+    std::cout << std::setw(8) << std::setprecision(1) << totalRooms / count;
+    std::cout << std::setw(8) << std::setprecision(3) << totalFloor / count;
+    std::cout << std::setw(9) << actorFailures << std::setw(9) << itemFailures << '\n';
+    std::cout.unsetf(std::ios::fixed);
+}
+
+static void runMapgenStats(const SimOptions &options) {
+    std::vector<const DungeonData*> levels;
+    for (unsigned depth = getDungeonEntranceIdent(); ; ++depth) {
+        const DungeonData &data = getDungeonData(depth);
+        if (data.ident == BAD_VALUE) break;
+        if (!data.fromFile) levels.push_back(&data);
+    }
+
+    // each thread takes the next seed from the list until they run out
+    std::atomic<unsigned> nextSeed(0);
+    std::vector<std::vector<MapgenResult>> threadResults(options.threadCount);
+    auto startTime = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < options.threadCount; ++i) {
+        threads.push_back(std::thread([&, i]() {
+            while (1) {
+                unsigned index = nextSeed++;
+                if (index >= options.seeds.size()) break;
+                for (const DungeonData *data : levels) {
+                    threadResults[i].push_back(generateForStats(*data, options.seeds[index]));
+                }
+            }
+        }));
+    }
+    for (std::thread &thread : threads) thread.join();
+    auto endTime = std::chrono::steady_clock::now();
+
+    std::map<unsigned, std::vector<MapgenResult>> byLevel;
+    std::vector<MapgenResult> badSeeds;
+    for (const std::vector<MapgenResult> &results : threadResults) {
+        for (const MapgenResult &result : results) {
+            byLevel[result.levelIdent].push_back(result);
+            if (result.failed || result.stats.retries > 0) badSeeds.push_back(result);
+        }
+    }
+
+    std::cout << std::left << std::setw(7) << "level" << std::right;
+    std::cout << std::setw(7) << "runs" << std::setw(7) << "fails";
+    std::cout << std::setw(9) << "mean ms" << std::setw(9) << "p99 ms";
+    std::cout << std::setw(9) << "retries" << std::setw(9) << "doors";
+    std::cout << std::setw(8) << "rooms" << std::setw(8) << "floor";
+    std::cout << std::setw(9) << "actors" << std::setw(9) << "items" << '\n';
+    for (auto &level : byLevel) reportMapgenStats(level.first, level.second);
+
+    std::sort(badSeeds.begin(), badSeeds.end(), [](const MapgenResult &lhs, const MapgenResult &rhs) {
+        if (lhs.seed != rhs.seed) return lhs.seed < rhs.seed;
+        return lhs.levelIdent < rhs.levelIdent;
+    });
+    for (const MapgenResult &result : badSeeds) {
+        std::cout << "seed " << result.seed << ", level " << result.levelIdent << ": ";
+        if (result.failed)  std::cout << "generation failed\n";
+        else                std::cout << result.stats.retries << " retries\n";
+    }
+
+    double seconds = std::chrono::duration<double>(endTime - startTime).count();
+    std::cout << options.seeds.size() << " seeds, " << levels.size() << " levels each, ";
+    std::cout << options.threadCount << " threads, " << seconds << " s\n";
+}
+
+
+/* ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****
+ * FOV ENGINE CHECK
+ * Runs both FOV engines from every passable tile of every level and reports
+ * any tile where they disagree.
+ * ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** ***** *****/
+
+// the burst radii checked, as well as the unlimited player FOV
+static const int fovCheckRadii[] = { 1, 2, 3, 4, 5, 6, 8, 10, 15, 20, 40, 70 };
+
+static std::vector<bool> fovSnapshot(const Dungeon &d, bool forCalc) {
+    std::vector<bool> visible(d.width() * d.height());
+    for (int y = 0; y < d.height(); ++y) {
+        for (int x = 0; x < d.width(); ++x) {
+            Coord here(x, y);
+            visible[y * d.width() + x] = forCalc ? d.inFovCalc(here) : d.isSeen(here);
+        }
+    }
+    return visible;
+}
+
+static std::vector<bool> runFovEngine(Dungeon &d, int engine, const Coord &origin, int radius, Actor *viewer) {
+    setFovEngine(engine);
+    if (radius < 0) {
+        d.clearIsSeen();
+        viewer->position = origin;
+        handlePlayerFOV(&d, viewer);
+        return fovSnapshot(d, false);
+    }
+    d.clearFovCalc();
+    fovCalcBurst(&d, origin, radius);
+    return fovSnapshot(d, true);
+}
+
+// returns the number of FOV calculations that differed
+static unsigned checkFovLevel(Dungeon &d, Actor *viewer, uint64_t seed) {
+    unsigned mismatches = 0;
+    for (int y = 0; y < d.height(); ++y) {
+        for (int x = 0; x < d.width(); ++x) {
+            Coord here(x, y);
+            if (!d.isPassable(here)) continue;
+            std::vector<int> radii(std::begin(fovCheckRadii), std::end(fovCheckRadii));
+            radii.push_back(-1);
+            for (int radius : radii) {
+                std::vector<bool> expected = runFovEngine(d, FOV_DIAMOND_WALLS, here, radius, viewer);
+                std::vector<bool> actual = runFovEngine(d, FOV_BIT_PARALLEL, here, radius, viewer);
+                if (expected == actual) continue;
+                ++mismatches;
+                std::cout << "seed " << seed << ", level " << d.depth() << ", from " << x << ',' << y;
+                if (radius < 0) std::cout << ", player FOV\n";
+                else            std::cout << ", burst radius " << radius << '\n';
+            }
+        }
+    }
+    return mismatches;
+}
+
+static bool runFovCheck(const SimOptions &options) {
+    RNG rng(1);
+    Actor *viewer = Actor::create(getActorData(0), rng);
+    unsigned levels = 0, mismatches = 0;
+    for (uint64_t seed : options.seeds) {
+        for (unsigned depth = getDungeonEntranceIdent(); ; ++depth) {
+            const DungeonData &data = getDungeonData(depth);
+            if (data.ident == BAD_VALUE) break;
+            Dungeon *d = generateDungeon(data, seed);
+            if (!d) continue;
+            mismatches += checkFovLevel(*d, viewer, seed);
+            ++levels;
+            delete d;
+        }
+    }
+    delete viewer;
+    setFovEngine(FOV_BIT_PARALLEL);
+    std::cout << options.seeds.size() << " seeds, " << levels << " levels, ";
+    std::cout << mismatches << " mismatches\n";
+    return mismatches == 0;
+}
+
+
+static bool loadScript(const std::string &filename, std::vector<std::string> &script) {
+    std::ifstream inf(filename);
+    if (!inf) {
+        std::cerr << "Failed to open script file " << filename << ".\n";
+        return false;
+    }
+    std::stringstream content;
+    content << inf.rdbuf();
+    int lineNumber = 0;
+    std::string line;
+    while (std::getline(content, line)) {
+        ++lineNumber;
+        auto parts = explodeOnWhitespace(line);
+        if (parts.empty() || parts[0][0] == '#') continue;
+        for (const std::string &part : parts) {
+            if (part != "wait" && part != "rest" && part != "take" && part != "stairs"
+                    && directionFromName(part) == Direction::Unknown) {
+                std::cerr << filename << ": " << lineNumber << "  unknown action " << part << '\n';
+                return false;
+            }
+            script.push_back(part);
+        }
+    }
+    if (script.empty()) {
+        std::cerr << "Script file " << filename << " contains no actions.\n";
+        return false;
+    }
+    return true;
+}
+
+static void showUsage(const char *programName) {
+    std::cerr << "USAGE: " << programName << " [options] [seed ...]\n";
+    std::cerr << "    -turns N          stop each run after N game turns (default 5000)\n";
+    std::cerr << "    -count N          run seeds 1 through N (if no seeds are listed)\n";
+    std::cerr << "    -policy NAME      player policy: random (default), wait, or script\n";
+    std::cerr << "    -script FILE      action list for the script policy; one or more of\n";
+    std::cerr << "                      wait, rest, take, stairs, or a direction name per line\n";
+    std::cerr << "    -fov NAME         FOV engine: bitparallel (default) or diamond, the\n";
+    std::cerr << "                      reference implementation\n";
+    std::cerr << "    -mapgen           generate every level for each seed and report statistics\n";
+    std::cerr << "                      instead of playing\n";
+    std::cerr << "    -fovcheck         check that both FOV engines see the same tiles from every\n";
+    std::cerr << "                      passable tile of each seed's levels instead of playing\n";
+    std::cerr << "    -threads N        number of threads for -mapgen (default: one per core)\n";
+}
+
+static bool parseArguments(int argc, char *argv[], SimOptions &options) {
+    unsigned seedCount = 10;
+    std::string scriptFile;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "-turns" && hasValue) {
+            if (!strToInt(argv[++i], options.maxTurns) || options.maxTurns == 0) {
+                std::cerr << "Turn limit must be a positive integer.\n";
+                return false;
+            }
+        } else if (arg == "-count" && hasValue) {
+            if (!strToInt(argv[++i], seedCount) || seedCount == 0) {
+                std::cerr << "Seed count must be a positive integer.\n";
+                return false;
+            }
+        } else if (arg == "-policy" && hasValue) {
+            std::string name = argv[++i];
+            if (name == "random")       options.policy = SimPolicy::RandomWalk;
+            else if (name == "wait")    options.policy = SimPolicy::Wait;
+            else if (name == "script")  options.policy = SimPolicy::Script;
+            else {
+                std::cerr << "Unknown policy " << name << ".\n";
+                return false;
+            }
+        } else if (arg == "-fov" && hasValue) {
+            std::string name = argv[++i];
+            if (name == "bitparallel")  setFovEngine(FOV_BIT_PARALLEL);
+            else if (name == "diamond") setFovEngine(FOV_DIAMOND_WALLS);
+            else {
+                std::cerr << "Unknown FOV engine " << name << ".\n";
+                return false;
+            }
+        } else if (arg == "-mapgen") {
+            options.mapgenOnly = true;
+        } else if (arg == "-fovcheck") {
+            options.fovCheck = true;
+        } else if (arg == "-threads" && hasValue) {
+            if (!strToInt(argv[++i], options.threadCount) || options.threadCount == 0) {
+                std::cerr << "Thread count must be a positive integer.\n";
+                return false;
+            }
+        } else if (arg == "-script" && hasValue) {
+            scriptFile = argv[++i];
+            options.policy = SimPolicy::Script;
+        } else if (arg[0] != '-') {
+            unsigned seed = 0;
+            if (!strToInt(arg, seed) || seed == 0) {
+                std::cerr << "Game seeds must be non-zero integer values.\n";
+                return false;
+            }
+            options.seeds.push_back(seed);
+        } else {
+            showUsage(argv[0]);
+            return false;
+        }
+    }
+
+    if (options.policy == SimPolicy::Script) {
+        if (scriptFile.empty()) {
+            std::cerr << "The script policy requires a script file.\n";
+            return false;
+        }
+        if (!loadScript(scriptFile, options.script)) return false;
+    }
+    if (options.seeds.empty()) {
+        for (unsigned i = 1; i <= seedCount; ++i) options.seeds.push_back(i);
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    SimOptions options{SimPolicy::RandomWalk, 5000, false, false, std::thread::hardware_concurrency()};
+    if (options.threadCount == 0) options.threadCount = 1;
+    if (!parseArguments(argc, argv, options)) return 1;
+
+    if (!headlessStartup(argv[0])) return 1;
+    if (options.mapgenOnly) {
+        runMapgenStats(options);
+        PHYSFS_deinit();
+        return 0;
+    }
+    if (options.fovCheck) {
+        bool passed = runFovCheck(options);
+        PHYSFS_deinit();
+        return passed ? 0 : 1;
+    }
+
+    unsigned totalTurns = 0, deaths = 0;
+    double totalSeconds = 0.0;
+    for (uint64_t seed : options.seeds) {
+        SimResult result = runSimulation(options, seed);
+        totalTurns += result.turns;
+        totalSeconds += result.seconds;
+        if (result.playerDied) ++deaths;
+        std::cout << "seed " << result.seed << ": " << result.turns << " turns, ";
+        std::cout << result.actions << " actions, deepest level " << result.deepestLevel;
+        if (result.playerDied) std::cout << ", died";
+        std::cout << ", " << result.seconds * 1000.0 << " ms";
+        if (result.seconds > 0) std::cout << " (" << static_cast<unsigned>(result.turns / result.seconds) << " turns/s)";
+        std::cout << '\n';
+    }
+
+    std::cout << options.seeds.size() << " runs, " << totalTurns << " turns, ";
+    std::cout << deaths << " deaths, " << totalSeconds << " s";
+    if (totalSeconds > 0) std::cout << " (" << static_cast<unsigned>(totalTurns / totalSeconds) << " turns/s)";
+    std::cout << '\n';
+
+    PHYSFS_deinit();
+    return 0;
+}
@@ -14,30 +14,6 @@ GameReturn gameloop(World &world);
 GameReturn keyBindingsMenu();
 void doDebugCodex();
 
-RNG globalRNG;
-
-World* createGame(uint64_t gameSeed, unsigned iteration) {
-    if (iteration > 50) {
-        logMessage(LOG_ERROR, " world generation experienced catastraphic failure");
-        return nullptr;
-    }
-    World *world = new World;
-    if (gameSeed == 0)  world->gameSeed = globalRNG.next32();
-    else                world->gameSeed = gameSeed;
-    logMessage(LOG_INFO, "NEW GAME with seed: " + std::to_string(world->gameSeed));
-    world->player = Actor::create(getActorData(0));
-    world->player->isPlayer = true;
-    world->player->reset();
-    if (!world->movePlayerToDepth(getDungeonEntranceIdent(), DE_ENTRANCE)) {
-        logMessage(LOG_INFO, "world generation failed");
-        uint64_t newSeed = world->gameSeed + 1;
-        delete world;
-        return createGame(newSeed, iteration + 1);
-    }
-    world->addMessage("Welcome to [color=yellow]MorphRL[/color]!");
-    return world;
-}
-
 struct UIRect {
     int x, y, w, h, ident;
 };
@@ -58,6 +34,18 @@ int keyToInt(int key) {
     }
 }
 
+static const std::string SAVE_PATH = std::string("/saves/") + SAVE_FILENAME;
+
+// Keep the save file in step with the game in progress. A finished game, won
+// or lost, can't be resumed, so its save is removed instead.
+static void updateSavedGame(const World *world) {
+    if (world && !world->player->isDead() && world->gameState != GameState::Victory) {
+        if (!saveGame(*world, SAVE_FILENAME)) ui_alertBox("Error", "Failed to save game.");
+    } else if (PHYSFS_exists(SAVE_PATH.c_str())) {
+        PHYSFS_delete(SAVE_FILENAME);
+    }
+}
+
 int main(int argc, char *argv[]) {
     PHYSFS_init(argv[0]);
     const char *writeDir = PHYSFS_getPrefDir("grendrake", "morphrl");
@@ -83,6 +71,7 @@ int main(int argc, char *argv[]) {
     PHYSFS_mount("gamedata.dat", "/", 1);
     if (!loadAllData()) return 1;
     loadKeybinds();
+    if (configData.getBoolValue("reference_fov", false)) setFovEngine(FOV_DIAMOND_WALLS);
 
     int fontSize = configData.getIntValue("fontsize", 24);
 
@@ -188,6 +177,7 @@ int main(int argc, char *argv[]) {
                         ui_alertBox("Error", "Could not create game world.");
                     } else {
                         GameReturn ret = gameloop(*world);
+                        updateSavedGame(world);
                         if (ret == GameReturn::FullQuit || world->gameState == GameState::Victory) {
                             delete world;
                             world = nullptr;
@@ -197,8 +187,13 @@ int main(int argc, char *argv[]) {
                     }
                     break; }
                 case 2:
+                    if (!world && PHYSFS_exists(SAVE_PATH.c_str())) {
+                        world = loadGame(SAVE_FILENAME);
+                        if (!world) ui_alertBox("Error", "Could not load saved game.");
+                    }
                     if (world) {
                         GameReturn ret = gameloop(*world);
+                        updateSavedGame(world);
                         if (ret == GameReturn::FullQuit || world->gameState == GameState::Victory) {
                             delete world;
                             world = nullptr;
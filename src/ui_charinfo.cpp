@@ -280,6 +280,7 @@ void doCharInfo(World &world) {
             if (player->isDead() || selection >= STAT_BASE_COUNT || player->advancementPoints < 1) continue;
             --player->advancementPoints;
             ++player->statLevels[selection];
+            player->invalidateStats();
         }
 
         if (key == TK_CLOSE || key == TK_ESCAPE) return;
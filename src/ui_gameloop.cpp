@@ -31,34 +31,34 @@ std::string previewMapSpace(World &world, const Coord &where) {
     if (!world.map->isValidPosition(where)) {
         return youveNeverSeenThatSpace;
     }
-    const MapTile *tile = world.map->at(where);
-    if (tile) {
-        std::stringstream s;
-        const TileData &td = getTileData(tile->floor);
-        if (!tile->everSeen || tile->floor == TILE_NOTHING) {
-            return youveNeverSeenThatSpace;
-        } else if (tile->isSeen) {
-            s << "You see: [color=yellow]" << td.name << "[/color]";
-            if (tile->temperature < 0) s << " ([color=cyan]cold[/color] area)";
-            if (tile->temperature > 0) s << " ([color=red]hot[/color] area)";
-            if (tile->actor || !tile->items.empty()) s << " containing";
-            if (tile->actor) {
-                s << " [color=yellow]" << tile->actor->getName() << "[/color] (";
-                s << percentOf(tile->actor->health, tile->actor->getStat(STAT_HEALTH));
-                s << "%)";
-            }
-            if (tile->actor && !tile->items.empty()) s << " and";
-            if (!tile->items.empty()) {
-                s << ' ';
-                s << makeItemList(tile->items, 4);
-            }
-            s << '.';
-        } else {
-            s << "You saw: [color=yellow]" << td.name << "[/color].";
+    std::stringstream s;
+    const int floor = world.map->floorAt(where);
+    const TileData &td = getTileData(floor);
+    const Actor *actor = world.map->actorAt(where);
+    const std::vector<Item*> &items = world.map->itemsAt(where);
+    const int temperature = world.map->temperatureAt(where);
+    if (!world.map->everSeen(where) || floor == TILE_NOTHING) {
+        return youveNeverSeenThatSpace;
+    } else if (world.map->isSeen(where)) {
+        s << "You see: [color=yellow]" << td.name << "[/color]";
+        if (temperature < 0) s << " ([color=cyan]cold[/color] area)";
+        if (temperature > 0) s << " ([color=red]hot[/color] area)";
+        if (actor || !items.empty()) s << " containing";
+        if (actor) {
+            s << " [color=yellow]" << actor->getName() << "[/color] (";
+            s << percentOf(actor->health, actor->getStat(STAT_HEALTH));
+            s << "%)";
+        }
+        if (actor && !items.empty()) s << " and";
+        if (!items.empty()) {
+            s << ' ';
+            s << makeItemList(items, 4);
         }
-        return s.str();
+        s << '.';
+    } else {
+        s << "You saw: [color=yellow]" << td.name << "[/color].";
     }
-    return youveNeverSeenThatSpace;
+    return s.str();
 }
 
 Direction keyToDirection(int key) {
@@ -86,22 +86,21 @@ void glyphAndColourForCoord(const World &world, const Coord &where, int &glyph,
         return;
     }
 
-    const MapTile *tile = world.map->at(where);
-    const TileData &td = getTileData(tile->floor);
-    const Actor *actor = tile->actor;
-    const Item *item = tile->items.empty() ? nullptr : tile->items.front();
+    const TileData &td = getTileData(world.map->floorAt(where));
+    const Actor *actor = world.map->actorAt(where);
+    const Item *item = world.map->itemAt(where);
 
     bkcolor = color_from_argb(255, 0, 0, 0);
 
     // if we've never seen the space, don't show it
-    if (!world.disableFOV && !tile->everSeen) {
+    if (!world.disableFOV && !world.map->everSeen(where)) {
         color = bkcolor;
         glyph = ' ';
         return;
     }
 
     // if we can currently see the space, show its content
-    if (world.disableFOV || tile->isSeen) {
+    if (world.disableFOV || world.map->isSeen(where)) {
         if (actor) {
             color = color_from_argb(255, actor->data.r, actor->data.g, actor->data.b);
             glyph = actor->data.glyph;
@@ -137,6 +136,87 @@ void drawStatBar(int x, int y, int amount, int maximum, color_t filledColour) {
     }
 }
 
+// The map part of the game screen, double buffered. Each frame is built up in
+// one grid and compared against the grid of what's already on screen, so only
+// the cells that changed are sent to BearLibTerminal.
+class MapView {
+public:
+    static const int width = 80;
+    static const int height = 19;
+
+    MapView() : mValid(false) { }
+
+    // forget what's on screen, so that the next frame sends every cell; for
+    // when something else may have drawn over the map
+    void invalidate() { mValid = false; }
+    bool isValid() const { return mValid; }
+    // forget just part of it, for text drawn on top of the map
+    void invalidate(int x, int y, int w, int h);
+
+    void put(int x, int y, int glyph, color_t fgColor, color_t bgColor) {
+        mNext[y][x] = Cell{glyph, fgColor, bgColor};
+    }
+    // sends the changed cells of the frame that was put to the terminal
+    void present();
+private:
+    struct Cell {
+        int glyph;
+        color_t fgColor, bgColor;
+        bool operator==(const Cell &rhs) const {
+            return glyph == rhs.glyph && fgColor == rhs.fgColor && bgColor == rhs.bgColor;
+        }
+    };
+    // cells with a glyph of -1 never match anything put, so they're always sent
+    static const int unknownGlyph = -1;
+
+    bool mValid;
+    Cell mShown[height][width];
+    Cell mNext[height][width];
+};
+
+void MapView::invalidate(int x, int y, int w, int h) {
+    for (int cy = std::max(y, 0); cy < y + h && cy < height; ++cy) {
+        for (int cx = std::max(x, 0); cx < x + w && cx < width; ++cx) {
+            mShown[cy][cx].glyph = unknownGlyph;
+        }
+    }
+}
+
+void MapView::present() {
+    if (!mValid) {
+        invalidate(0, 0, width, height);
+        mValid = true;
+    }
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const Cell &cell = mNext[y][x];
+            if (cell == mShown[y][x]) continue;
+            terminal_color(cell.fgColor);
+            terminal_bkcolor(cell.bgColor);
+            terminal_put(x, y, cell.glyph);
+            mShown[y][x] = cell;
+        }
+    }
+}
+
+// Whether handling a key in the game loop is certain not to draw anything of
+// its own (a dialog, another screen) over the map, so that what's on screen
+// can be kept. This only needs to cover the common keys; anything else just
+// costs a full redraw.
+static bool keyKeepsScreen(int key, unsigned uiMode) {
+    if (key == TK_RESIZED) return false;
+    if (uiMode == MODE_NORMAL || uiMode == MODE_DEAD) {
+        if (key == TK_MOUSE_RIGHT) return true;
+        int action = getBindingForKey(key, uiMode).action;
+        return action == ACT_NONE || action == ACT_MOVE || action == ACT_WAIT;
+    }
+    if (uiMode == MODE_EXAMINE_TILE) {
+        // confirming shows the actor info screen
+        return key != TK_ENTER && key != TK_SPACE && key != TK_KP_ENTER;
+    }
+    return uiMode == MODE_CHOOSE_TARGET;
+}
+
 struct ListItem {
     std::string name;
     unsigned value;
@@ -160,11 +240,15 @@ GameReturn gameloop(World &world) {
     unsigned uiMode = MODE_NORMAL;
     Coord cursorPos(-1, -1);
     bool shownDeathMessage = false;
-    std::vector<Coord> targetArea;
+    EffectArea targetArea;
     unsigned uiModeParam = 0;
     int targetAreaType = AR_NONE;
     int targetAreaRange = 0;
     std::vector<ListItem> uiListOfThings;
+    MapView mapView;
+    // how many lines each message in the log takes; messages don't change
+    // once added, so each only needs measuring once
+    std::vector<int> messageHeights;
     clock_t timer = 0;
     while (1) {
         if (world.gameState == GameState::Victory) {
@@ -185,17 +269,24 @@ GameReturn gameloop(World &world) {
         int offsetY = world.player->position.y - 10;
         terminal_color(textColour);
         terminal_bkcolor(black);
-        terminal_clear();
+        // the map keeps what's on screen from the last frame unless something
+        // else has been drawn since; the rows below it are always redrawn
+        if (mapView.isValid()) terminal_clear_area(0, MapView::height, 80, 25 - MapView::height);
+        else terminal_clear();
 
         // show log (we do this first so we can remove any extra bits that would
         // overlap other UI elements)
         unsigned yPos = 24;
         if (uiMode == MODE_NORMAL || uiMode == MODE_DEAD) {
-            for (auto iter = world.messages.rbegin(); iter != world.messages.rend(); ++iter) {
-                dimensions_t dims = terminal_measure_ext(77, 5, iter->text.c_str());
-                if (dims.height > 1) yPos -= dims.height - 1;
+            if (messageHeights.size() > world.messages.size()) messageHeights.clear();
+            messageHeights.resize(world.messages.size(), 0);
+            for (unsigned i = world.messages.size(); i > 0; --i) {
+                const std::string &text = world.messages[i - 1].text;
+                int &height = messageHeights[i - 1];
+                if (height == 0) height = terminal_measure_ext(77, 5, text.c_str()).height;
+                if (height > 1) yPos -= height - 1;
                 terminal_put(0, yPos, '*');
-                terminal_print_ext(2, yPos, 77, 5, TK_ALIGN_DEFAULT, iter->text.c_str());
+                terminal_print_ext(2, yPos, 77, 5, TK_ALIGN_DEFAULT, text.c_str());
                 --yPos;
                 if (yPos < 20) break;
             }
@@ -227,11 +318,24 @@ GameReturn gameloop(World &world) {
         } else {
             logMessage(LOG_ERROR, "Unsupported UIMode " + std::to_string(static_cast<int>(uiMode)) + " in display");
         }
-        terminal_clear_area(0, 0, 80, 20);
+        if (yPos + 1 < MapView::height) {
+            // a long message ran up into the map
+            terminal_clear_area(0, 0, 80, MapView::height);
+            mapView.invalidate();
+        }
+        terminal_clear_area(0, MapView::height, 80, 1);
 
         // draw interface frame
         for (int x = 0; x < 80; ++x) terminal_put(x, 19, 0x2500);
 
+        // find the screen cells covered by the animation overlay once, rather
+        // than searching it for every cell drawn
+        bool isOverlay[19][80] = {};
+        for (const Coord &pos : world.map->overlayTiles) {
+            int sx = pos.x - offsetX, sy = pos.y - offsetY;
+            if (sx >= 0 && sy >= 0 && sx < 80 && sy < 19) isOverlay[sy][sx] = true;
+        }
+
         // draw map
         for (int y = 0; y < 19; ++y) {
             for (int x = 0; x < 80; ++x) {
@@ -240,23 +344,21 @@ GameReturn gameloop(World &world) {
                 int glyph;
                 glyphAndColourForCoord(world, here, glyph, bgColor, fgColor);
 
-                terminal_color(fgColor);
-                terminal_bkcolor(bgColor);
                 if (uiMode == MODE_EXAMINE_TILE && here == cursorPos) {
-                    terminal_bkcolor(cursorColour);
+                    bgColor = cursorColour;
                 } else if (uiMode == MODE_CHOOSE_TARGET) {
                     if (here == cursorPos) {
-                        terminal_bkcolor(cursorColour);
-                    } else if (vectorContains(targetArea, here)) terminal_bkcolor(targetLineColour);
-                } else if (world.map->inOverlay(here)) {
-                    terminal_color(color_from_argb(255, world.map->overlayR, world.map->overlayG, world.map->overlayB));
-                    terminal_put(x, y, world.map->overlayGlyph);
-                    continue;
+                        bgColor = cursorColour;
+                    } else if (targetArea.contains(here)) bgColor = targetLineColour;
+                } else if (isOverlay[y][x]) {
+                    fgColor = color_from_argb(255, world.map->overlayR, world.map->overlayG, world.map->overlayB);
+                    glyph = world.map->overlayGlyph;
                 }
 
-                terminal_put(x, y, glyph);
+                mapView.put(x, y, glyph, fgColor, bgColor);
             }
         }
+        mapView.present();
 
         // Health, energy, and level name info
         std::string healthLine = std::to_string(world.player->health) + "/"
@@ -284,6 +386,7 @@ GameReturn gameloop(World &world) {
         timer = newTimer;
         terminal_printf(61, 2, "Tick time: %u", timeTaken);
         terminal_printf(61, 3, "Since Combat: %u", world.player->turnsSinceCombatAction);
+        mapView.invalidate(61, 0, 19, 4);
 #endif
 
         terminal_refresh();
@@ -301,6 +404,7 @@ GameReturn gameloop(World &world) {
         // ///// ///// ///// ///// ///// ///// ///// ///// ///// ///// /////
         // INPUT HANDLING
         int key = terminal_read();
+        if (!keyKeepsScreen(key, uiMode)) mapView.invalidate();
 #ifdef DEBUG
         timer = clock();
 #endif
@@ -428,8 +532,8 @@ GameReturn gameloop(World &world) {
             }
             if (key == TK_ENTER || key == TK_SPACE || key == TK_KP_ENTER) {
                 uiMode = MODE_NORMAL;
-                const MapTile *tile = world.map->at(cursorPos);
-                if (tile && tile->isSeen && tile->actor) showActorInfo(world, tile->actor);
+                Actor *actor = world.map->actorAt(cursorPos);
+                if (actor && world.map->isSeen(cursorPos)) showActorInfo(world, actor);
             }
             Direction theDir = keyToDirection(key);
             if (theDir != Direction::Unknown) {
@@ -466,7 +570,7 @@ GameReturn gameloop(World &world) {
                     world.addMessage("Tried to use invalid ability");
                 } else {
                     if (data.areaType == AR_NONE || data.areaType == AR_BURST) {
-                        targetArea = world.map->getEffectArea(world.player->position, world.player->position, data.areaType, data.maxRange, false, false);
+                        world.map->getEffectArea(world.player->position, world.player->position, data.areaType, data.maxRange, false, false, targetArea);
                         world.map->activateAbility(world, data.ident, world.player->position, targetArea);
                         world.player->advanceSpeedCounter(data.speedMult);
                         world.tick();
@@ -476,7 +580,7 @@ GameReturn gameloop(World &world) {
                         uiModeParam = ident;
                         uiMode = MODE_CHOOSE_DIRECTION;
                         uiModeString = "Choose direction for " + data.name + ".";
-                        targetArea = world.map->getEffectArea(world.player->position, cursorPos, targetAreaType, targetAreaRange, false, false);
+                        world.map->getEffectArea(world.player->position, cursorPos, targetAreaType, targetAreaRange, false, false, targetArea);
                     } else {
                         cursorPos = world.player->position;
                         targetAreaRange = data.maxRange;
@@ -484,7 +588,7 @@ GameReturn gameloop(World &world) {
                         uiModeParam = ident;
                         uiMode = MODE_CHOOSE_TARGET;
                         uiModeString = "Choose target for " + data.name + ".";
-                        targetArea = world.map->getEffectArea(world.player->position, cursorPos, targetAreaType, targetAreaRange, false, false);
+                        world.map->getEffectArea(world.player->position, cursorPos, targetAreaType, targetAreaRange, false, false, targetArea);
                     }
                 }
             }
@@ -498,7 +602,7 @@ GameReturn gameloop(World &world) {
                 if (my < 19) {
                     cursorPos.x = mx + offsetX;
                     cursorPos.y = my + offsetY;
-                    targetArea = world.map->getEffectArea(world.player->position, cursorPos, targetAreaType, targetAreaRange, false, false);
+                    world.map->getEffectArea(world.player->position, cursorPos, targetAreaType, targetAreaRange, false, false, targetArea);
                 }
             }
             if (key == TK_ESCAPE || key == TK_X || key == TK_MOUSE_RIGHT) {
@@ -519,7 +623,7 @@ GameReturn gameloop(World &world) {
             Direction theDir = keyToDirection(key);
             if (theDir != Direction::Unknown) {
                 cursorPos = cursorPos.shift(theDir);
-                targetArea = world.map->getEffectArea(world.player->position, cursorPos, targetAreaType, targetAreaRange, false, false);
+                world.map->getEffectArea(world.player->position, cursorPos, targetAreaType, targetAreaRange, false, false, targetArea);
             }
 
         // ///// ///// ///// ///// ///// ///// ///// ///// ///// ///// /////
@@ -539,7 +643,7 @@ GameReturn gameloop(World &world) {
                         break; }
                     case UI_USE_ABILITY: {
                         const AbilityData &abilityData = getAbilityData(uiModeParam);
-                        targetArea = world.map->getEffectArea(world.player->position, world.player->position.shift(theDir), targetAreaType, targetAreaRange, false, false);
+                        world.map->getEffectArea(world.player->position, world.player->position.shift(theDir), targetAreaType, targetAreaRange, false, false, targetArea);
                         world.map->activateAbility(world, uiModeParam, cursorPos, targetArea);
                         world.player->advanceSpeedCounter(abilityData.speedMult);
                         world.tick();
@@ -28,6 +28,7 @@ void useItem(World &world, Item *item) {
                 item->isEquipped = true;
                 msg << "Now wielding [color=yellow]" << item->getName(true) << "[/color].";
             }
+            world.player->invalidateStats();
             world.addMessage(msg.str());
             world.tick();
             return;
@@ -46,6 +47,7 @@ void useItem(World &world, Item *item) {
                     return;
                 }
             }
+            world.player->invalidateStats();
             world.addMessage(msg.str());
             world.tick();
             return;
@@ -68,15 +70,16 @@ void doInventory(World &world, bool showFloor) {
     terminal_bkcolor(black);
     terminal_clear();
 
-    MapTile *floorTile = world.map->at(world.player->position);
-    if (!floorTile) {
+    if (!world.map->isValidPosition(world.player->position)) {
         logMessage(LOG_ERROR, "player standing on non-existant floor tile");
         return;
     }
     const int maxBulk = world.player->getStat(STAT_BULK_MAX);
     int selection = 0;
+    std::vector<Item*> floorItems;
     while (1) {
-        std::vector<Item*> &currentInventory = showFloor ? floorTile->items : world.player->inventory;
+        if (showFloor) floorItems = world.map->itemsAt(world.player->position);
+        std::vector<Item*> &currentInventory = showFloor ? floorItems : world.player->inventory;
         const int curBulk = world.player->getStat(STAT_BULK);
         const std::string bulkString = "[font=italic]Carried Bulk: " + std::to_string(curBulk) +
                                        " of " + std::to_string(maxBulk);
@@ -32,7 +32,7 @@ std::string& trim(std::string &text) {
     return text;
 }
 
-const std::string& trim(const std::string &text) {
+std::string trim(const std::string &text) {
     std::string copiedText(text);
     return trim(copiedText);
 }
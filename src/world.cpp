@@ -1,64 +1,96 @@
+#include <functional>
+#include <future>
 #include <iostream>
 #include "morph.h"
 
 World::World()
-: map(nullptr), currentTurn(0), disableFOV(false), showCombatMath(true),
+: player(nullptr), map(nullptr), currentTurn(0), disableFOV(false), showCombatMath(true),
   gameState(GameState::Normal)
 { }
 
 World::~World() {
-    if (map) delete map;
+    for (auto &pending : mPendingLevels) delete pending.second.get();
+    for (Dungeon *d : levels) delete d;
+    delete player;
+}
+
+// Each level draws from its own stream of the game's generator, chosen by the
+// level's ident, with any retries carrying on along the same stream, so a level
+// comes out the same no matter when, or on which thread, it's generated.
+Dungeon* generateDungeon(const DungeonData &dungeonData, uint64_t gameSeed) {
+    RNG rng = gameStream(gameSeed, RNG_STREAM_LEVELS + dungeonData.ident);
+    for (int iteration = 0; iteration <= 50; ++iteration) {
+        Dungeon *newMap = new Dungeon(dungeonData, dungeonData.mapgen.width, dungeonData.mapgen.height);
+        if (!newMap) return nullptr;
+        if (newMap->data.fromFile) {
+            newMap->loadMapFromFile("map_" + std::to_string(dungeonData.ident) + ".map");
+            return newMap;
+        }
+        doMapgen(*newMap, rng);
+        // verify map connectivity
+        Coord entrance = newMap->firstOfTile(TILE_GRASS);
+        Coord downStair = newMap->firstOfTile(TILE_STAIR_DOWN);
+        Coord upStair = newMap->firstOfTile(TILE_STAIR_UP);
+        Coord startPos = entrance;
+        if (startPos.x < 0) startPos = downStair;
+        if (startPos.x < 0) startPos = upStair;
+        if (startPos.x < 0) {
+            logMessage(LOG_ERROR, "Failed to find entrance, or up or down stair");
+            delete newMap;
+            continue;
+        }
+        newMap->calcDistances(startPos);
+        // ensure all exits are accessable
+        if ( (entrance.x >= 0 && newMap->distanceAt(entrance) < 0) ||
+             (upStair.x >= 0 && newMap->distanceAt(upStair) < 0) ||
+             (downStair.x >= 0 && newMap->distanceAt(downStair) < 0) ) {
+            logMessage(LOG_ERROR, "map connectivity failed");
+            delete newMap;
+            continue;
+        }
+        newMap->mapgenStats.retries = iteration;
+        return newMap;
+    }
+    logMessage(LOG_ERROR, "Unable to generate dungeon for depth " + std::to_string(dungeonData.ident));
+    return nullptr;
 }
 
 Dungeon* World::getDungeon(int depth) {
     for (Dungeon *d : levels) {
         if (d->depth() == depth) return d;
     }
+    // take over the level if it's already being generated in the background
+    auto pending = mPendingLevels.find(depth);
+    if (pending != mPendingLevels.end()) {
+        Dungeon *newMap = pending->second.get();
+        mPendingLevels.erase(pending);
+        if (newMap) levels.push_back(newMap);
+        return newMap;
+    }
     // otherwise existing level not found, create new
     const DungeonData &dungeonData = getDungeonData(depth);
     if (dungeonData.ident == BAD_VALUE) {
         logMessage(LOG_ERROR, "Failed to find dungeon for depth " + std::to_string(depth));
         return nullptr;
     }
-    int iteration = -1;
-    auto oldSeed = globalRNG.getState();
-    while (1) {
-        ++iteration;
-        if (iteration > 50) {
-            logMessage(LOG_ERROR, "Unable to generate dungeon for depth " + std::to_string(depth));
-            return nullptr;
-        }
-        Dungeon *newMap = new Dungeon(dungeonData, MAP_WIDTH, MAP_HEIGHT);
-        if (!newMap) return nullptr;
-        globalRNG.seed(gameSeed + dungeonData.ident + iteration);
-        if (newMap->data.fromFile) {
-            newMap->loadMapFromFile("map_" + std::to_string(dungeonData.ident) + ".map");
-        } else {
-            doMapgen(*newMap);
-            // verify map connectivity
-            Coord entrance = newMap->firstOfTile(TILE_GRASS);
-            Coord downStair = newMap->firstOfTile(TILE_STAIR_DOWN);
-            Coord upStair = newMap->firstOfTile(TILE_STAIR_UP);
-            Coord startPos = entrance;
-            if (startPos.x < 0) startPos = downStair;
-            if (startPos.x < 0) startPos = upStair;
-            if (startPos.x < 0) {
-                logMessage(LOG_ERROR, "Failed to find entrance, or up or down stair");
-                continue;
-            }
-            newMap->calcDistances(startPos);
-            // ensure all exits are accessable
-            if ( (entrance.x >= 0 && newMap->distanceAt(entrance) < 0) ||
-                 (upStair.x >= 0 && newMap->distanceAt(upStair) < 0) ||
-                 (downStair.x >= 0 && newMap->distanceAt(downStair) < 0) ) {
-                logMessage(LOG_ERROR, "map connectivity failed");
-                continue;
-            }
-        }
+    Dungeon *newMap = generateDungeon(dungeonData, gameSeed);
+    if (newMap) levels.push_back(newMap);
+    return newMap;
+}
 
-        globalRNG.seed(oldSeed);
-        levels.push_back(newMap);
-        return newMap;
+// Start generating the levels above and below the given depth on worker
+// threads so they're ready by the time the player takes the stairs.
+void World::pregenerateLevels(int aroundDepth) {
+    for (int depth : { aroundDepth - 1, aroundDepth + 1 }) {
+        const DungeonData &dungeonData = getDungeonData(depth);
+        if (dungeonData.ident == BAD_VALUE) continue;
+        if (mPendingLevels.count(depth)) continue;
+        bool isGenerated = false;
+        for (const Dungeon *d : levels) {
+            if (d->depth() == depth) isGenerated = true;
+        }
+        if (isGenerated) continue;
+        mPendingLevels[depth] = std::async(std::launch::async, generateDungeon, std::cref(dungeonData), gameSeed);
     }
 }
 
@@ -89,14 +121,15 @@ bool World::movePlayerToDepth(int newDepth, int enterFrom) {
 
     if (startPosition.x < 0) {
         logMessage(LOG_ERROR, "failed to find valid start position.");
-        startPosition.x = MAP_WIDTH / 2;
-        startPosition.y = MAP_HEIGHT / 2;
+        startPosition.x = map->width() / 2;
+        startPosition.y = map->height() / 2;
         return false;
     }
     logMessage(LOG_INFO, "initial position @ " + startPosition.toString());
     map->addActor(player, startPosition);
     map->resetSpeedCounter();
     map->doActorFOV(player);
+    pregenerateLevels(newDepth);
     return true;
 }
 
@@ -111,3 +144,31 @@ void World::tick() {
         map->doActorFOV(player);
     }
 }
+
+World* createGame(uint64_t gameSeed, unsigned iteration) {
+    if (iteration > 50) {
+        logMessage(LOG_ERROR, " world generation experienced catastraphic failure");
+        return nullptr;
+    }
+    // seeded from the clock; only used to pick seeds for new games
+    static RNG seedPicker;
+    World *world = new World;
+    if (gameSeed == 0)  world->gameSeed = seedPicker.next32();
+    else                world->gameSeed = gameSeed;
+    logMessage(LOG_INFO, "NEW GAME with seed: " + std::to_string(world->gameSeed));
+    // the AI stream is the one straight after the combat stream
+    RNG streams = gameStream(world->gameSeed, RNG_STREAM_COMBAT);
+    world->combatRNG = streams.split();
+    world->aiRNG = streams.split();
+    world->player = Actor::create(getActorData(0), world->combatRNG);
+    world->player->isPlayer = true;
+    world->player->reset();
+    if (!world->movePlayerToDepth(getDungeonEntranceIdent(), DE_ENTRANCE)) {
+        logMessage(LOG_INFO, "world generation failed");
+        uint64_t newSeed = world->gameSeed + 1;
+        delete world;
+        return createGame(newSeed, iteration + 1);
+    }
+    world->addMessage("Welcome to [color=yellow]MorphRL[/color]!");
+    return world;
+}